@@ -0,0 +1,217 @@
+#include "benchmark.h"
+#include "mockserver.h"
+#include <QtSocketIo/QSocketIoClientPool>
+#include <QtSocketIo/QSocketIoMetrics>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+#include <QtCore/QTextStream>
+#include <QtCore/QJsonArray>
+
+namespace
+{
+//kilobytes, or -1 where /proc is not available
+qint64 residentMemory()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    Q_FOREVER {
+        const QByteArray line = status.readLine();
+        if (line.isEmpty()) {
+            return -1;
+        }
+        if (line.startsWith("VmRSS:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+        }
+    }
+}
+
+void merge(QSocketIoHistogram *total, const QSocketIoHistogram &histogram)
+{
+    if (histogram.count == 0) {
+        return;
+    }
+    if (total->buckets.isEmpty()) {
+        total->buckets.fill(0, QSocketIoHistogram::BucketCount);
+    }
+    for (int i = 0; i < histogram.buckets.size(); ++i) {
+        total->buckets[i] += histogram.buckets.at(i);
+    }
+    total->count += histogram.count;
+    total->sum += histogram.sum;
+    total->maximum = qMax(total->maximum, histogram.maximum);
+}
+
+double perSecond(qint64 count, qint64 nsecs)
+{
+    return nsecs > 0 ? double(count) * 1e9 / double(nsecs) : 0.0;
+}
+}
+
+Benchmark::Benchmark(MockServer *server, QObject *parent) :
+    QObject(parent),
+    m_pServer(server),
+    m_messages(1000),
+    m_events(1000),
+    m_threads(-1),
+    m_timeout(120000),
+    m_acks(0),
+    m_ackErrors(0),
+    m_ticks(0)
+{
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+//per client and scenario; acked emits stay below the default limit of
+//1024 pending acks
+void Benchmark::setMessages(int messages)
+{
+    m_messages = qBound(1, messages, 1024);
+}
+
+void Benchmark::setEvents(int events)
+{
+    m_events = qMax(1, events);
+}
+
+void Benchmark::setThreads(int threads)
+{
+    m_threads = threads;
+}
+
+void Benchmark::setTimeout(int msecs)
+{
+    m_timeout = msecs;
+}
+
+bool Benchmark::run(const QList<int> &clientCounts)
+{
+    bool succeeded = true;
+    for (int i = 0; i < clientCounts.size(); ++i) {
+        succeeded = runScenario(clientCounts.at(i)) && succeeded;
+    }
+    return succeeded;
+}
+
+//spins the event loop of the calling thread until condition() holds
+bool Benchmark::waitFor(const std::function<bool()> &condition)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition()) {
+        if (timer.elapsed() > m_timeout) {
+            return false;
+        }
+        QCoreApplication::processEvents();
+        QThread::usleep(200);
+    }
+    return true;
+}
+
+bool Benchmark::runScenario(int clients)
+{
+    QTextStream out(stdout);
+    out << "== " << clients << " client(s), " << m_messages << " emits and "
+        << m_events << " events each ==" << endl;
+
+    m_acks.storeRelease(0);
+    m_ackErrors.storeRelease(0);
+    m_ticks.storeRelease(0);
+    QAtomicInt *ticks = &m_ticks;
+
+    const qint64 memoryBefore = residentMemory();
+    QSocketIoClientPool pool;
+    connect(&pool, &QSocketIoClientPool::clientCreated, [ticks](QSocketIoClient *client, int) {
+        client->setMetricsEnabled(true);
+        client->on(QStringLiteral("tick"), [ticks](QJsonArray) {
+            ticks->fetchAndAddRelaxed(1);
+        });
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    const QUrl url(QStringLiteral("ws://127.0.0.1:%1").arg(m_pServer->port()));
+    pool.open(url, clients, m_threads);
+    if (!waitFor([this, clients]() { return m_pServer->connections() >= clients; })) {
+        out << "  timed out connecting; " << m_pServer->connections() << " connected" << endl;
+        return false;
+    }
+    const qint64 connectTime = timer.nsecsElapsed();
+    const qint64 memoryAfter = residentMemory();
+    out << "  connect:         " << connectTime / 1000000 << " ms over "
+        << pool.threadCount() << " thread(s)" << endl;
+    if (memoryBefore >= 0 && memoryAfter >= 0) {
+        out << "  memory:          " << double(memoryAfter - memoryBefore) / clients
+            << " KiB per connection, client and server side" << endl;
+    }
+
+    //emit throughput, counted where the server receives the events
+    const quint64 receivedBefore = m_pServer->eventsReceived();
+    const quint64 expected = quint64(clients) * quint64(m_messages);
+    timer.restart();
+    for (int i = 0; i < m_messages; ++i) {
+        for (int c = 0; c < clients; ++c) {
+            pool.client(c)->emitMessage(QStringLiteral("bench"), i);
+        }
+    }
+    if (!waitFor([this, receivedBefore, expected]() {
+                     return m_pServer->eventsReceived() - receivedBefore >= expected; })) {
+        out << "  timed out emitting" << endl;
+        return false;
+    }
+    out << "  emit throughput: " << perSecond(qint64(expected), timer.nsecsElapsed())
+        << " events/s" << endl;
+
+    //ack round trips, from the clients' own metrics
+    QAtomicInt *acks = &m_acks;
+    QAtomicInt *ackErrors = &m_ackErrors;
+    timer.restart();
+    for (int i = 0; i < m_messages; ++i) {
+        for (int c = 0; c < clients; ++c) {
+            pool.client(c)->emitMessage(QStringLiteral("bench"), QVariant(i),
+                                        [acks](QJsonArray) { acks->fetchAndAddRelaxed(1); },
+                                        [ackErrors](QSocketIo::AckError) {
+                ackErrors->fetchAndAddRelaxed(1);
+            });
+        }
+    }
+    if (!waitFor([this, expected]() {
+                     return quint64(m_acks.loadAcquire() + m_ackErrors.loadAcquire()) >= expected; })) {
+        out << "  timed out waiting for acks" << endl;
+        return false;
+    }
+    const qint64 ackTime = timer.nsecsElapsed();
+    QSocketIoHistogram latency;
+    for (int c = 0; c < clients; ++c) {
+        merge(&latency, pool.client(c)->metrics().ackLatency);
+    }
+    out << "  ack throughput:  " << perSecond(m_acks.loadAcquire(), ackTime) << " acks/s, "
+        << m_ackErrors.loadAcquire() << " failed" << endl;
+    out << "  ack round trip:  p50 " << latency.percentile(0.5)
+        << " us, p99 " << latency.percentile(0.99)
+        << " us, p99.9 " << latency.percentile(0.999)
+        << " us, max " << latency.maximum << " us" << endl;
+
+    //inbound dispatch: every client asks for m_events ticks
+    const qint64 expectedTicks = qint64(clients) * m_events;
+    timer.restart();
+    for (int c = 0; c < clients; ++c) {
+        pool.client(c)->emitMessage(QStringLiteral("flood"), m_events);
+    }
+    if (!waitFor([this, expectedTicks]() { return m_ticks.loadAcquire() >= expectedTicks; })) {
+        out << "  timed out waiting for events" << endl;
+        return false;
+    }
+    out << "  event dispatch:  " << perSecond(expectedTicks, timer.nsecsElapsed())
+        << " events/s" << endl;
+
+    pool.close();
+    waitFor([this]() { return m_pServer->connections() == 0; });
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QAtomicInt>
+#include <functional>
+
+class MockServer;
+
+//Runs every scenario against the MockServer once per client count:
+//emit throughput, ack round trips, inbound event dispatch and the resident
+//memory that each connection adds on both ends of the loopback.
+class Benchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Benchmark(MockServer *server, QObject *parent = Q_NULLPTR);
+    virtual ~Benchmark();
+
+    void setMessages(int messages);
+    void setEvents(int events);
+    void setThreads(int threads);
+    void setTimeout(int msecs);
+
+    bool run(const QList<int> &clientCounts);
+
+private:
+    Q_DISABLE_COPY(Benchmark)
+
+    bool runScenario(int clients);
+    bool waitFor(const std::function<bool()> &condition);
+
+    MockServer *m_pServer;
+    int m_messages;
+    int m_events;
+    int m_threads;
+    int m_timeout;
+    QAtomicInt m_acks;
+    QAtomicInt m_ackErrors;
+    QAtomicInt m_ticks;
+};
+
+#endif // BENCHMARK_H
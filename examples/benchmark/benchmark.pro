@@ -0,0 +1,19 @@
+QT       += core network websockets socketio
+QT       -= gui
+
+TARGET = benchmark
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    mockserver.cpp \
+    benchmark.cpp \
+    parserbenchmark.cpp
+
+HEADERS += \
+    mockserver.h \
+    benchmark.h \
+    parserbenchmark.h
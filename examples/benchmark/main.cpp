@@ -0,0 +1,80 @@
+#include "mockserver.h"
+#include "benchmark.h"
+#include "parserbenchmark.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QThread>
+#include <QtCore/QDebug>
+
+//Everything runs over loopback: the mock server in a thread of its own,
+//the clients in a QSocketIoClientPool. At 10000 clients the process needs
+//about 20000 file descriptors; raise the limit with ulimit -n first.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("QtSocketIo loopback benchmark"));
+    parser.addHelpOption();
+    QCommandLineOption clientsOption(QStringLiteral("clients"),
+                                     QStringLiteral("Comma separated client counts."),
+                                     QStringLiteral("counts"), QStringLiteral("1,100,10000"));
+    QCommandLineOption messagesOption(QStringLiteral("messages"),
+                                      QStringLiteral("Emits per client, at most 1024."),
+                                      QStringLiteral("count"), QStringLiteral("1000"));
+    QCommandLineOption eventsOption(QStringLiteral("events"),
+                                    QStringLiteral("Server events per client."),
+                                    QStringLiteral("count"), QStringLiteral("1000"));
+    QCommandLineOption threadsOption(QStringLiteral("threads"),
+                                     QStringLiteral("Client threads; one per core by default."),
+                                     QStringLiteral("count"), QStringLiteral("-1"));
+    QCommandLineOption parserOption(QStringLiteral("parser"),
+                                    QStringLiteral("Only benchmark frame parsing, this many "
+                                                   "rounds over a set of frames."),
+                                    QStringLiteral("rounds"));
+    parser.addOption(clientsOption);
+    parser.addOption(messagesOption);
+    parser.addOption(eventsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(parserOption);
+    parser.process(app);
+
+    if (parser.isSet(parserOption)) {
+        ParserBenchmark parserBenchmark;
+        parserBenchmark.setIterations(parser.value(parserOption).toInt());
+        parserBenchmark.run();
+        return 0;
+    }
+
+    QList<int> clientCounts;
+    const QStringList counts = parser.value(clientsOption).split(QLatin1Char(','));
+    for (int i = 0; i < counts.size(); ++i) {
+        const int count = counts.at(i).toInt();
+        if (count > 0) {
+            clientCounts << count;
+        }
+    }
+
+    QThread serverThread;
+    serverThread.setObjectName(QStringLiteral("MockServer"));
+    MockServer *server = new MockServer;
+    server->moveToThread(&serverThread);
+    serverThread.start();
+    bool listening = false;
+    QMetaObject::invokeMethod(server, "listen", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, listening), Q_ARG(quint16, 0));
+
+    bool succeeded = false;
+    if (listening) {
+        Benchmark benchmark(server);
+        benchmark.setMessages(parser.value(messagesOption).toInt());
+        benchmark.setEvents(parser.value(eventsOption).toInt());
+        benchmark.setThreads(parser.value(threadsOption).toInt());
+        succeeded = benchmark.run(clientCounts);
+    }
+
+    server->deleteLater();
+    serverThread.quit();
+    serverThread.wait();
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include "mockserver.h"
+#include <QtSocketIo/QSocketIoFrameParser>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtWebSockets/QWebSocket>
+#include <QtWebSockets/QWebSocketServer>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+#include <QtCore/QTimer>
+#include <QtCore/QDebug>
+
+MockServer::MockServer(QObject *parent) :
+    QObject(parent),
+    m_pTcpServer(new QTcpServer(this)),
+    m_pWebSocketServer(new QWebSocketServer(QStringLiteral("MockServer"),
+                                            QWebSocketServer::NonSecureMode, this)),
+    m_pHeartbeatTimer(new QTimer(this)),
+    m_sockets(),
+    m_heartbeatTimeout(60),
+    m_closeTimeout(60),
+    m_port(0),
+    m_connections(0),
+    m_eventsReceived(0),
+    m_lastSessionId(0),
+    m_heldAcks()
+{
+    connect(m_pTcpServer, SIGNAL(newConnection()), this, SLOT(onNewTcpConnection()));
+    connect(m_pWebSocketServer, SIGNAL(newConnection()), this, SLOT(onNewWebSocket()));
+    connect(m_pHeartbeatTimer, SIGNAL(timeout()), this, SLOT(sendHeartbeats()));
+    //socket.io 0.9 sends heartbeats every 25 seconds
+    m_pHeartbeatTimer->setInterval(25000);
+}
+
+MockServer::~MockServer()
+{
+}
+
+quint16 MockServer::port() const
+{
+    return quint16(m_port.loadAcquire());
+}
+
+int MockServer::connections() const
+{
+    return m_connections.loadAcquire();
+}
+
+quint64 MockServer::eventsReceived() const
+{
+    return m_eventsReceived.loadAcquire();
+}
+
+//listens on the loopback interface only; 0 picks a free port
+bool MockServer::listen(quint16 port)
+{
+    m_pTcpServer->setMaxPendingConnections(1 << 16);
+    if (!m_pTcpServer->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "MockServer: cannot listen:" << m_pTcpServer->errorString();
+        return false;
+    }
+    m_port.storeRelease(m_pTcpServer->serverPort());
+    if (m_pHeartbeatTimer->interval() > 0) {
+        m_pHeartbeatTimer->start();
+    }
+    return true;
+}
+
+//what the handshake advertises to clients that connect from now on
+void MockServer::setHeartbeatTimeout(int seconds)
+{
+    m_heartbeatTimeout = seconds;
+}
+
+void MockServer::setCloseTimeout(int seconds)
+{
+    m_closeTimeout = seconds;
+}
+
+//0 stops the heartbeats, so that clients see a silent server
+void MockServer::setHeartbeatInterval(int msecs)
+{
+    m_pHeartbeatTimer->stop();
+    m_pHeartbeatTimer->setInterval(msecs);
+    if (msecs > 0 && m_pTcpServer->isListening()) {
+        m_pHeartbeatTimer->start();
+    }
+}
+
+void MockServer::sendHeartbeats()
+{
+    for (QSet<QWebSocket *>::const_iterator it = m_sockets.constBegin();
+         it != m_sockets.constEnd(); ++it) {
+        (*it)->sendTextMessage(QStringLiteral("2::"));
+    }
+}
+
+void MockServer::onNewTcpConnection()
+{
+    while (m_pTcpServer->hasPendingConnections()) {
+        QTcpSocket *socket = m_pTcpServer->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onTcpReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+//only peeks until a request head is complete, so that an upgrade request
+//reaches the WebSocket server untouched. Handshakes keep the connection
+//alive, as a client may send its next handshake over it.
+void MockServer::onTcpReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+    Q_FOREVER {
+        const QByteArray buffered = socket->peek(socket->bytesAvailable());
+        const int headEnd = buffered.indexOf("\r\n\r\n");
+        if (headEnd < 0) {
+            return;
+        }
+        const QByteArray head = buffered.left(headEnd).toLower();
+        if (head.contains("upgrade: websocket")) {
+            disconnect(socket, SIGNAL(readyRead()), this, SLOT(onTcpReadyRead()));
+            disconnect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+            m_pWebSocketServer->handleConnection(socket);
+            return;
+        }
+
+        //the handshake is a GET without a body
+        (void)socket->read(headEnd + 4);
+        //sid:heartbeat timeout:close timeout:transports
+        const QByteArray body = QByteArray::number(++m_lastSessionId) + ':'
+                + QByteArray::number(m_heartbeatTimeout) + ':'
+                + QByteArray::number(m_closeTimeout) + ":websocket";
+        socket->write("HTTP/1.1 200 OK\r\n"
+                      "Content-Type: text/plain\r\n"
+                      "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                      "Connection: keep-alive\r\n"
+                      "\r\n" + body);
+    }
+}
+
+void MockServer::onNewWebSocket()
+{
+    while (m_pWebSocketServer->hasPendingConnections()) {
+        QWebSocket *socket = m_pWebSocketServer->nextPendingConnection();
+        connect(socket, SIGNAL(textMessageReceived(QString)), this, SLOT(onTextMessage(QString)));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(onWebSocketDisconnected()));
+        socket->sendTextMessage(QStringLiteral("1::"));
+        m_sockets.insert(socket);
+        m_connections.fetchAndAddRelaxed(1);
+    }
+}
+
+void MockServer::onWebSocketDisconnected()
+{
+    QWebSocket *socket = qobject_cast<QWebSocket *>(sender());
+    if (socket) {
+        m_heldAcks.remove(socket);
+        m_sockets.remove(socket);
+        m_connections.fetchAndAddRelaxed(-1);
+        socket->deleteLater();
+    }
+}
+
+void MockServer::onTextMessage(QString message)
+{
+    QWebSocket *socket = qobject_cast<QWebSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+    const QByteArray payload = message.toUtf8();
+    if (QSocketIoFrameParser::isFramedPayload(payload)) {
+        int position = 0;
+        QByteArray packet;
+        while (QSocketIoFrameParser::readFramedPacket(payload, &position, &packet)) {
+            handlePacket(socket, packet);
+        }
+    } else {
+        handlePacket(socket, payload);
+    }
+}
+
+void MockServer::handlePacket(QWebSocket *socket, const QByteArray &packet)
+{
+    QSocketIoFrameParser parser;
+    if (!parser.parse(packet)) {
+        qWarning() << "MockServer: invalid packet" << packet;
+        return;
+    }
+    const QByteArray endpoint = parser.endpoint();
+    switch (parser.packetType()) {
+        case QSocketIoFrameParser::DisconnectPacket:
+        {
+            if (endpoint.isEmpty()) {
+                socket->close();
+            }
+            break;
+        }
+        case QSocketIoFrameParser::ConnectPacket:
+        {
+            socket->sendTextMessage(QString::fromUtf8("1::" + endpoint));
+            break;
+        }
+        case QSocketIoFrameParser::MessagePacket:
+        case QSocketIoFrameParser::JsonMessagePacket:
+        {
+            socket->sendTextMessage(QString::fromUtf8(packet));
+            break;
+        }
+        case QSocketIoFrameParser::EventPacket:
+        {
+            m_eventsReceived.fetchAndAddRelaxed(1);
+            const QJsonObject event = QJsonDocument::fromJson(parser.data()).object();
+            const QJsonArray arguments = event.value(QStringLiteral("args")).toArray();
+            const QString name = event.value(QStringLiteral("name")).toString();
+            if (parser.messageId() > 0) {
+                QByteArray ack = "6::" + endpoint + ':' + QByteArray::number(parser.messageId());
+                if (parser.isDataAck()) {
+                    ack += '+';
+                    ack += QJsonDocument(arguments).toJson(QJsonDocument::Compact);
+                }
+                if (name == QLatin1String("hold")) {
+                    m_heldAcks[socket].append(ack);
+                } else {
+                    socket->sendTextMessage(QString::fromUtf8(ack));
+                }
+            }
+            if (name == QLatin1String("release")) {
+                const QList<QByteArray> acks = m_heldAcks.take(socket);
+                for (int i = 0; i < acks.size(); ++i) {
+                    socket->sendTextMessage(QString::fromUtf8(acks.at(i)));
+                }
+            }
+            if (name == QLatin1String("fault")) {
+                //reason+advice
+                QByteArray error = "7::" + endpoint + ':';
+                error += arguments.at(0).toString().toUtf8();
+                if (arguments.size() > 1) {
+                    error += '+';
+                    error += arguments.at(1).toString().toUtf8();
+                }
+                socket->sendTextMessage(QString::fromUtf8(error));
+                socket->sendTextMessage(QString::fromUtf8("8::" + endpoint));
+            }
+            if (name == QLatin1String("flood")) {
+                const int count = arguments.at(0).toInt();
+                const QByteArray prefix = "5::" + endpoint + ":{\"name\":\"tick\",\"args\":[";
+                for (int i = 0; i < count; ++i) {
+                    socket->sendTextMessage(QString::fromUtf8(prefix + QByteArray::number(i) + "]}"));
+                }
+            }
+            break;
+        }
+        default:
+        {
+            //heartbeats, acks, errors and noops need no answer
+        }
+    }
+}
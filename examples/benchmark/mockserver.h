@@ -0,0 +1,69 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+
+class QTimer;
+class QTcpServer;
+class QWebSocket;
+class QWebSocketServer;
+
+//An in-process stand-in for a socket.io 0.9 server. One port serves both
+//the /socket.io/1/ handshake and the WebSocket transport: requests that
+//ask for an upgrade are handed to a QWebSocketServer, anything else gets a
+//handshake reply. Events are acknowledged with their own arguments; the
+//event "flood" makes the server send back as many "tick" events as its
+//first argument says. Acks for the event "hold" are kept back until the
+//same connection emits "release". The event "fault" is answered with an
+//error packet, its arguments being the reason and the advice, and a noop.
+//Heartbeats go out to every connection on an interval of their own.
+class MockServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MockServer(QObject *parent = Q_NULLPTR);
+    virtual ~MockServer();
+
+    //safe to call from any thread
+    quint16 port() const;
+    int connections() const;
+    quint64 eventsReceived() const;
+
+public Q_SLOTS:
+    bool listen(quint16 port);
+    void setHeartbeatTimeout(int seconds);
+    void setCloseTimeout(int seconds);
+    void setHeartbeatInterval(int msecs);
+
+private Q_SLOTS:
+    void onNewTcpConnection();
+    void onTcpReadyRead();
+    void onNewWebSocket();
+    void onTextMessage(QString message);
+    void onWebSocketDisconnected();
+    void sendHeartbeats();
+
+private:
+    Q_DISABLE_COPY(MockServer)
+
+    void handlePacket(QWebSocket *socket, const QByteArray &packet);
+
+    QTcpServer *m_pTcpServer;
+    QWebSocketServer *m_pWebSocketServer;
+    QTimer *m_pHeartbeatTimer;
+    QSet<QWebSocket *> m_sockets;
+    int m_heartbeatTimeout;
+    int m_closeTimeout;
+    QAtomicInt m_port;
+    QAtomicInt m_connections;
+    QAtomicInteger<quint64> m_eventsReceived;
+    int m_lastSessionId;
+    QHash<QWebSocket *, QList<QByteArray> > m_heldAcks;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,121 @@
+#include "parserbenchmark.h"
+#include <QtSocketIo/QSocketIoFrameParser>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRegExp>
+#include <QtCore/QTextStream>
+
+namespace
+{
+double perSecond(qint64 count, qint64 nsecs)
+{
+    return nsecs > 0 ? double(count) * 1e9 / double(nsecs) : 0.0;
+}
+}
+
+//a mix of what a client receives: events, acks with and without data,
+//heartbeats, messages, and payloads with multibyte characters
+ParserBenchmark::ParserBenchmark() :
+    m_frames(),
+    m_iterations(100000)
+{
+    m_frames << QStringLiteral("2::")
+             << QStringLiteral("5:::{\"name\":\"tick\",\"args\":[42]}")
+             << QStringLiteral("5:17+:/chat:{\"name\":\"message\",\"args\":[{\"user\":\"alice\","
+                               "\"text\":\"hello there\",\"time\":1402671234}]}")
+             << QString::fromUtf8("5:::/chat:{\"name\":\"message\",\"args\":[\"gr\xc3\xbc\xc3\x9f"
+                                  " \xe2\x82\xac \xf0\x9f\x98\x80\"]}")
+             << QStringLiteral("6:::12")
+             << QStringLiteral("6:::13+[\"ok\",{\"count\":3}]")
+             << QStringLiteral("3:::a plain message")
+             << QStringLiteral("1::/chat");
+}
+
+void ParserBenchmark::setIterations(int iterations)
+{
+    m_iterations = qMax(1, iterations);
+}
+
+void ParserBenchmark::run()
+{
+    QTextStream out(stdout);
+    const qint64 frames = qint64(m_frames.size()) * m_iterations;
+    out << "== parser, " << frames << " frames ==" << endl;
+
+    //both checksums cover the same fields, so that neither loop can be
+    //optimized away and both have to agree
+    quint64 regExpChecksum = 0;
+    quint64 parserChecksum = 0;
+    const qint64 regExpTime = runRegExp(&regExpChecksum);
+    const qint64 parserTime = runParser(&parserChecksum);
+
+    out << "QRegExp:              " << qRound64(perSecond(frames, regExpTime)) << " frames/s" << endl;
+    out << "QSocketIoFrameParser: " << qRound64(perSecond(frames, parserTime)) << " frames/s";
+    if (parserTime > 0) {
+        out << " (" << QString::number(double(regExpTime) / double(parserTime), 'f', 1) << "x)";
+    }
+    out << endl;
+    if (regExpChecksum != parserChecksum) {
+        out << "checksums differ: " << regExpChecksum << " != " << parserChecksum << endl;
+    }
+}
+
+//as the client parsed frames before: a QRegExp per frame, on the QString
+//that QWebSocket delivers, with a second one for the data of acks
+qint64 ParserBenchmark::runRegExp(quint64 *checksum) const
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < m_iterations; ++i) {
+        for (int f = 0; f < m_frames.size(); ++f) {
+            QRegExp regExp(QStringLiteral("^([^:]+):([0-9]+)?(\\+)?:([^:]+)?:?([\\s\\S]*)?$"),
+                           Qt::CaseInsensitive, QRegExp::RegExp2);
+            if (regExp.indexIn(m_frames.at(f)) == -1) {
+                continue;
+            }
+            const QStringList captured = regExp.capturedTexts();
+            const int messageType = captured.at(1).toInt();
+            int messageId = captured.at(2).toInt();
+            const QString endpoint = captured.at(4);
+            QString data = captured.at(5);
+            if (messageType == QSocketIoFrameParser::AckPacket) {
+                QRegExp ackExp(QStringLiteral("^([0-9]+)(\\+)?(.*)$"), Qt::CaseInsensitive,
+                               QRegExp::RegExp2);
+                if (ackExp.indexIn(data) != -1) {
+                    messageId = ackExp.cap(1).toInt();
+                    data = ackExp.cap(3);
+                }
+            }
+            *checksum += quint64(messageType) + quint64(messageId) + quint64(endpoint.size())
+                    + quint64(!data.isEmpty());
+        }
+    }
+    return timer.nsecsElapsed();
+}
+
+//as the client parses frames now: one conversion to UTF-8, then views
+//into it
+qint64 ParserBenchmark::runParser(quint64 *checksum) const
+{
+    QSocketIoFrameParser parser;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < m_iterations; ++i) {
+        for (int f = 0; f < m_frames.size(); ++f) {
+            const QByteArray frame = m_frames.at(f).toUtf8();
+            if (!parser.parse(frame)) {
+                continue;
+            }
+            int messageId = parser.messageId();
+            QByteArray data = parser.data();
+            if (parser.packetType() == QSocketIoFrameParser::AckPacket) {
+                QByteArray arguments;
+                if (QSocketIoFrameParser::parseAck(parser.data(), &messageId, &arguments)) {
+                    data = arguments;
+                }
+            }
+            *checksum += quint64(parser.packetType()) + quint64(messageId)
+                    + quint64(parser.endpoint().size()) + quint64(!data.isEmpty());
+        }
+    }
+    return timer.nsecsElapsed();
+}
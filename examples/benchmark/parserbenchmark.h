@@ -0,0 +1,28 @@
+#ifndef PARSERBENCHMARK_H
+#define PARSERBENCHMARK_H
+
+#include <QtCore/QStringList>
+
+//Tokenizes the same inbound frames with QSocketIoFrameParser and with the
+//QRegExp based parse that it replaced, without any networking, and reports
+//frames per second for both.
+class ParserBenchmark
+{
+public:
+    ParserBenchmark();
+
+    void setIterations(int iterations);
+
+    void run();
+
+private:
+    Q_DISABLE_COPY(ParserBenchmark)
+
+    qint64 runRegExp(quint64 *checksum) const;
+    qint64 runParser(quint64 *checksum) const;
+
+    QStringList m_frames;
+    int m_iterations;
+};
+
+#endif // PARSERBENCHMARK_H
@@ -1,3 +1,3 @@
 TEMPLATE = subdirs
 
-SUBDIRS = echoclient
+SUBDIRS = echoclient benchmark
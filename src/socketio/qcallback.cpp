@@ -0,0 +1,149 @@
+#include "qcallback.h"
+#include <QtCore/QObject>
+#include <QtCore/QVarLengthArray>
+
+namespace
+{
+//one slot argument; only the member that matches the parameter is used
+struct SlotArgument
+{
+    SlotArgument() : boolean(false), integer(0), longLong(0), number(0) {}
+
+    bool boolean;
+    int integer;
+    qint64 longLong;
+    double number;
+    QString string;
+    QByteArray byteArray;
+    QJsonValue jsonValue;
+    QJsonArray jsonArray;
+    QJsonObject jsonObject;
+    QVariant variant;
+};
+}
+
+SlotCallback::SlotCallback(const QObject *receiver, const QMetaMethod &method,
+                           Qt::ConnectionType type) :
+    m_pReceiver(const_cast<QObject *>(receiver)),
+    m_method(method),
+    m_type(type),
+    m_parameterKinds(),
+    m_parameterTypes(),
+    m_parameterNames(method.parameterTypes()),
+    m_argumentArray(false)
+{
+    const int count = qMin(int(MaximumParameters), method.parameterCount());
+    m_parameterKinds.reserve(count);
+    m_parameterTypes.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const int parameterType = method.parameterType(i);
+        ParameterKind kind = OtherParameter;
+        switch (parameterType) {
+            case QMetaType::Bool:           kind = BoolParameter; break;
+            case QMetaType::Int:            kind = IntParameter; break;
+            case QMetaType::LongLong:       kind = LongLongParameter; break;
+            case QMetaType::Double:         kind = DoubleParameter; break;
+            case QMetaType::QString:        kind = StringParameter; break;
+            case QMetaType::QByteArray:     kind = ByteArrayParameter; break;
+            case QMetaType::QJsonValue:     kind = JsonValueParameter; break;
+            case QMetaType::QJsonArray:     kind = JsonArrayParameter; break;
+            case QMetaType::QJsonObject:    kind = JsonObjectParameter; break;
+            case QMetaType::QVariant:       kind = VariantParameter; break;
+            default:                        break;
+        }
+        m_parameterKinds.append(kind);
+        m_parameterTypes.append(parameterType);
+    }
+    m_argumentArray = (count == 1 && m_parameterKinds.at(0) == JsonArrayParameter);
+}
+
+void SlotCallback::operator()(const QJsonArray &array, QSocketIoResponder *responder) const
+{
+    Q_UNUSED(responder);
+    QObject *receiver = m_pReceiver.data();
+    if (!receiver) {
+        return;
+    }
+
+    const int count = m_parameterKinds.size();
+    QVarLengthArray<SlotArgument, MaximumParameters> arguments(count);
+    QGenericArgument genericArguments[MaximumParameters];
+    for (int i = 0; i < count; ++i) {
+        SlotArgument &argument = arguments[i];
+        const QJsonValue value = m_argumentArray ? QJsonValue(array) : array.at(i);
+        const void *data = Q_NULLPTR;
+        switch (m_parameterKinds.at(i)) {
+            case BoolParameter:
+                argument.boolean = value.toBool();
+                data = &argument.boolean;
+                break;
+            case IntParameter:
+                argument.integer = int(value.toDouble());
+                data = &argument.integer;
+                break;
+            case LongLongParameter:
+                argument.longLong = qint64(value.toDouble());
+                data = &argument.longLong;
+                break;
+            case DoubleParameter:
+                argument.number = value.toDouble();
+                data = &argument.number;
+                break;
+            case StringParameter:
+                argument.string = value.toString();
+                data = &argument.string;
+                break;
+            case ByteArrayParameter:
+                argument.byteArray = QSocketIo::toByteArray(value);
+                data = &argument.byteArray;
+                break;
+            case JsonValueParameter:
+                argument.jsonValue = value;
+                data = &argument.jsonValue;
+                break;
+            case JsonArrayParameter:
+                argument.jsonArray = value.toArray();
+                data = &argument.jsonArray;
+                break;
+            case JsonObjectParameter:
+                argument.jsonObject = value.toObject();
+                data = &argument.jsonObject;
+                break;
+            case VariantParameter:
+                argument.variant = value.toVariant();
+                data = &argument.variant;
+                break;
+            case OtherParameter:
+                argument.variant = value.toVariant();
+                if (!argument.variant.convert(m_parameterTypes.at(i))) {
+                    argument.variant = QVariant(m_parameterTypes.at(i), Q_NULLPTR);
+                }
+                data = argument.variant.constData();
+                break;
+        }
+        genericArguments[i] = QGenericArgument(m_parameterNames.at(i).constData(), data);
+    }
+
+    if (!m_method.invoke(receiver, m_type,
+                         genericArguments[0], genericArguments[1], genericArguments[2],
+                         genericArguments[3], genericArguments[4], genericArguments[5],
+                         genericArguments[6], genericArguments[7], genericArguments[8],
+                         genericArguments[9])) {
+        qWarning("SlotCallback: could not invoke %s", m_method.methodSignature().constData());
+    }
+}
+
+//accepts the output of SLOT() and SIGNAL() as well as plain signatures
+QMetaMethod SlotCallback::findMethod(const QObject *receiver, const char *member)
+{
+    if (!receiver || !member) {
+        return QMetaMethod();
+    }
+    if (*member >= '0' && *member <= '2') {
+        ++member;   //the code that SLOT() and SIGNAL() put in front
+    }
+    const QMetaObject *metaObject = receiver->metaObject();
+    const QByteArray signature = QMetaObject::normalizedSignature(member);
+    const int index = metaObject->indexOfMethod(signature.constData());
+    return index < 0 ? QMetaMethod() : metaObject->method(index);
+}
@@ -2,24 +2,41 @@
 #define QCALLBACK_H
 
 #include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <QtCore/qglobal.h>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonValue>
+#include <QtCore/QMetaMethod>
+#include <QtCore/QPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QVariant>
+#include "qsocketio_global.h"
+#include "qsocketioresponder.h"
 
 QT_BEGIN_NAMESPACE
 
-class QAbstractCallback
+namespace QSocketIo
 {
-public:
-    QAbstractCallback() {}
-    virtual ~QAbstractCallback() {}
-
-    void operator()(QJsonArray array) {
-        callback(array);
-    }
-
-protected:
-    virtual void callback(QJsonArray array) = 0;
+enum AckError
+{
+    AckTimeoutError,
+    AckLimitError,
+    AckConnectionLostError,
+    AckQueueFullError
 };
 
+//Binary arguments travel as attachments: the JSON arguments hold a
+//placeholder for each one. While the handlers of an event run,
+//toByteArray() turns a placeholder into its attachment, without copying;
+//other values convert as a string. QByteArray parameters of handlers are
+//filled this way.
+Q_SOCKETIO_EXPORT bool isAttachment(const QJsonValue &value);
+Q_SOCKETIO_EXPORT QByteArray toByteArray(const QJsonValue &value);
+}
+
 template <typename...>
 struct List
 {
@@ -147,37 +164,480 @@ struct function_traits<ReturnValue (&)(Arguments...)>
     typedef void object_type;
 };
 
-template <typename Callback>
-class FunctionCallback:public QAbstractCallback
+template <int...>
+struct IndexList
+{
+};
+
+template <int N, int... Indices>
+struct MakeIndexList
+{
+    typedef typename MakeIndexList<N - 1, N - 1, Indices...>::Value Value;
+};
+
+template <int... Indices>
+struct MakeIndexList<0, Indices...>
+{
+    typedef IndexList<Indices...> Value;
+};
+
+//A type-erased callback. Callables up to the size of four pointers, which
+//covers the usual capturing lambda, are stored in place; larger ones are
+//moved to the heap.
+template <typename Signature>
+class InplaceCallback;
+
+template <typename ReturnValue, typename... Arguments>
+class InplaceCallback<ReturnValue(Arguments...)>
 {
 public:
-    FunctionCallback(Callback callback) : QAbstractCallback(), m_callback(callback)
+    InplaceCallback() : m_pOperations(Q_NULLPTR) {}
+
+    template <typename Callback>
+    InplaceCallback(Callback callback,
+                    typename std::enable_if<!std::is_same<Callback, InplaceCallback>::value>::type * = Q_NULLPTR) :
+        m_pOperations(Operations<Callback>::table())
+    {
+        Operations<Callback>::create(m_storage, std::move(callback));
+    }
+
+    InplaceCallback(const InplaceCallback &other) : m_pOperations(other.m_pOperations)
     {
+        if (m_pOperations) {
+            m_pOperations->copy(m_storage, other.m_storage);
+        }
     }
-    ~FunctionCallback() {}
 
-protected:
-    void callback(QJsonArray array) {
-        m_callback(array);
+    InplaceCallback(InplaceCallback &&other) : m_pOperations(other.m_pOperations)
+    {
+        if (m_pOperations) {
+            m_pOperations->move(m_storage, other.m_storage);
+            other.m_pOperations = Q_NULLPTR;
+        }
+    }
+
+    ~InplaceCallback() {
+        clear();
+    }
+
+    InplaceCallback &operator=(const InplaceCallback &other) {
+        if (this != &other) {
+            clear();
+            if (other.m_pOperations) {
+                other.m_pOperations->copy(m_storage, other.m_storage);
+                m_pOperations = other.m_pOperations;
+            }
+        }
+        return *this;
+    }
+
+    InplaceCallback &operator=(InplaceCallback &&other) {
+        if (this != &other) {
+            clear();
+            if (other.m_pOperations) {
+                other.m_pOperations->move(m_storage, other.m_storage);
+                m_pOperations = other.m_pOperations;
+                other.m_pOperations = Q_NULLPTR;
+            }
+        }
+        return *this;
+    }
+
+    bool isNull() const {
+        return !m_pOperations;
+    }
+
+    void clear() {
+        if (m_pOperations) {
+            m_pOperations->destroy(m_storage);
+            m_pOperations = Q_NULLPTR;
+        }
+    }
+
+    ReturnValue operator()(Arguments... arguments) const {
+        return m_pOperations->invoke(m_storage, std::forward<Arguments>(arguments)...);
     }
 
 private:
-    Callback m_callback;
+    enum { InlineSize = 4 * sizeof(void *) };
+
+    union Storage
+    {
+        void *pointer;
+        typename std::aligned_storage<InlineSize>::type buffer;
+    };
+
+    struct OperationTable
+    {
+        ReturnValue (*invoke)(Storage &storage, Arguments... arguments);
+        void (*copy)(Storage &destination, const Storage &source);
+        void (*move)(Storage &destination, Storage &source);
+        void (*destroy)(Storage &storage);
+    };
+
+    template <typename Callback,
+              bool Inline = sizeof(Callback) <= InlineSize
+                            && std::alignment_of<Callback>::value <= std::alignment_of<Storage>::value>
+    struct Operations
+    {
+        static Callback *get(Storage &storage) {
+            return reinterpret_cast<Callback *>(&storage.buffer);
+        }
+        static const Callback *get(const Storage &storage) {
+            return reinterpret_cast<const Callback *>(&storage.buffer);
+        }
+        static void create(Storage &storage, Callback &&callback) {
+            new (&storage.buffer) Callback(std::move(callback));
+        }
+        static ReturnValue invoke(Storage &storage, Arguments... arguments) {
+            return (*get(storage))(std::forward<Arguments>(arguments)...);
+        }
+        static void copy(Storage &destination, const Storage &source) {
+            new (&destination.buffer) Callback(*get(source));
+        }
+        static void move(Storage &destination, Storage &source) {
+            new (&destination.buffer) Callback(std::move(*get(source)));
+            get(source)->~Callback();
+        }
+        static void destroy(Storage &storage) {
+            get(storage)->~Callback();
+        }
+        static const OperationTable *table() {
+            static const OperationTable operations = { &invoke, &copy, &move, &destroy };
+            return &operations;
+        }
+    };
+
+    template <typename Callback>
+    struct Operations<Callback, false>
+    {
+        static Callback *get(const Storage &storage) {
+            return static_cast<Callback *>(storage.pointer);
+        }
+        static void create(Storage &storage, Callback &&callback) {
+            storage.pointer = new Callback(std::move(callback));
+        }
+        static ReturnValue invoke(Storage &storage, Arguments... arguments) {
+            return (*get(storage))(std::forward<Arguments>(arguments)...);
+        }
+        static void copy(Storage &destination, const Storage &source) {
+            destination.pointer = new Callback(*get(source));
+        }
+        static void move(Storage &destination, Storage &source) {
+            destination.pointer = source.pointer;
+        }
+        static void destroy(Storage &storage) {
+            delete get(storage);
+        }
+        static const OperationTable *table() {
+            static const OperationTable operations = { &invoke, &copy, &move, &destroy };
+            return &operations;
+        }
+    };
+
+    const OperationTable *m_pOperations;
+    mutable Storage m_storage;
+};
+
+//Converts one event argument to the type of the matching handler
+//parameter. Arguments the server did not send arrive as undefined values
+//and convert to the default of the type. Types that have no specialization
+//go through QVariant, so anything QVariant can convert to works.
+template <typename T, typename Enable = void>
+struct JsonArgument
+{
+    static T convert(const QJsonValue &value) {
+        return value.toVariant().value<T>();
+    }
+};
+
+template <typename T>
+struct JsonArgument<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+    static T convert(const QJsonValue &value) {
+        return T(value.toDouble());
+    }
+};
+
+template <>
+struct JsonArgument<bool>
+{
+    static bool convert(const QJsonValue &value) {
+        return value.toBool();
+    }
+};
+
+template <>
+struct JsonArgument<QString>
+{
+    static QString convert(const QJsonValue &value) {
+        return value.toString();
+    }
+};
+
+template <>
+struct JsonArgument<QByteArray>
+{
+    static QByteArray convert(const QJsonValue &value) {
+        return QSocketIo::toByteArray(value);
+    }
+};
+
+template <>
+struct JsonArgument<QJsonValue>
+{
+    static QJsonValue convert(const QJsonValue &value) {
+        return value;
+    }
+};
+
+template <>
+struct JsonArgument<QJsonArray>
+{
+    static QJsonArray convert(const QJsonValue &value) {
+        return value.toArray();
+    }
+};
+
+template <>
+struct JsonArgument<QJsonObject>
+{
+    static QJsonObject convert(const QJsonValue &value) {
+        return value.toObject();
+    }
+};
+
+template <>
+struct JsonArgument<QStringList>
+{
+    static QStringList convert(const QJsonValue &value) {
+        QStringList list;
+        const QJsonArray array = value.toArray();
+        for (QJsonArray::const_iterator it = array.constBegin(); it != array.constEnd(); ++it) {
+            list.append((*it).toString());
+        }
+        return list;
+    }
+};
+
+//Converts the return value of an event handler to the arguments of the
+//acknowledgement. A QJsonArray is taken as the whole argument list, as the
+//QJsonArray parameter of a handler is; any other value is sent as the only
+//argument.
+template <typename T, typename Enable = void>
+struct JsonResult
+{
+    static QJsonArray arguments(const T &value) {
+        return QJsonArray() << QJsonValue::fromVariant(QVariant::fromValue(value));
+    }
+};
+
+template <typename T>
+struct JsonResult<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+    static QJsonArray arguments(T value) {
+        return QJsonArray() << QJsonValue(double(value));
+    }
+};
+
+template <>
+struct JsonResult<bool>
+{
+    static QJsonArray arguments(bool value) {
+        return QJsonArray() << QJsonValue(value);
+    }
+};
+
+template <>
+struct JsonResult<QString>
+{
+    static QJsonArray arguments(const QString &value) {
+        return QJsonArray() << QJsonValue(value);
+    }
+};
+
+template <>
+struct JsonResult<QJsonValue>
+{
+    static QJsonArray arguments(const QJsonValue &value) {
+        return value.isUndefined() ? QJsonArray() : QJsonArray() << value;
+    }
 };
 
-/*class SlotCallback:public QAbstractCallback
+template <>
+struct JsonResult<QJsonObject>
 {
+    static QJsonArray arguments(const QJsonObject &value) {
+        return QJsonArray() << QJsonValue(value);
+    }
+};
+
+template <>
+struct JsonResult<QJsonArray>
+{
+    static QJsonArray arguments(const QJsonArray &value) {
+        return value;
+    }
+};
+
+template <>
+struct JsonResult<QStringList>
+{
+    static QJsonArray arguments(const QStringList &value) {
+        return QJsonArray() << QJsonValue(QJsonArray::fromStringList(value));
+    }
+};
+
+//a handler whose last parameter is a QSocketIoResponder replies through it
+template <typename L, int Size = L::size>
+struct TakesResponder
+{
+    enum { value = std::is_same<typename std::decay<typename ListLast<L>::Value>::type,
+                                QSocketIoResponder>::value };
+};
+
+template <typename L>
+struct TakesResponder<L, 0>
+{
+    enum { value = false };
+};
+
+//the parameters that are filled from the arguments of the event
+template <typename L>
+struct ArgumentCount
+{
+    enum { value = L::size - int(TakesResponder<L>::value) };
+};
+
+//a handler with a single QJsonArray parameter gets all arguments at once,
+//as handlers did before they could be typed
+template <typename L, int Count = ArgumentCount<L>::value>
+struct TakesArgumentArray
+{
+    enum { value = false };
+};
+
+template <typename L>
+struct TakesArgumentArray<L, 1>
+{
+    enum { value = std::is_same<typename std::decay<typename L::Car>::type, QJsonArray>::value };
+};
+
+//Adapts a handler with typed parameters to a callback that takes the
+//arguments of an event or ack. The arguments are unpacked at compile time,
+//each one converted straight from its JSON value. The return type of the
+//handler decides at compile time whether its result is the reply to the
+//event; acks have no responder, so the result of an ack handler is dropped.
+template <typename Callback>
+class TypedCallback
+{
+    typedef typename function_traits<Callback>::arguments Parameters;
+    typedef typename function_traits<Callback>::return_type ReturnValue;
+    typedef std::integral_constant<bool, bool(TakesResponder<Parameters>::value)> WithResponder;
+    typedef std::integral_constant<bool, bool(TakesArgumentArray<Parameters>::value)> ArgumentArray;
+    typedef typename MakeIndexList<ArgumentCount<Parameters>::value>::Value Indices;
+
 public:
-    SlotCallback(QObject *object, const char *member);
+    explicit TypedCallback(Callback callback) : m_callback(std::move(callback)) {}
 
-protected:
-    void callback(QJsonArray array) {
+    void operator()(const QJsonArray &array, QSocketIoResponder *responder) {
+        call(array, responder, std::is_void<ReturnValue>());
     }
 
 private:
-    QObject *m_pObject;
-    QByteArray m_member;
-};*/
+    Callback m_callback;
+
+    void call(const QJsonArray &array, QSocketIoResponder *responder, std::true_type) {
+        invoke(array, responder, Indices(), WithResponder(), ArgumentArray());
+    }
+
+    void call(const QJsonArray &array, QSocketIoResponder *responder, std::false_type) {
+        const ReturnValue result = invoke(array, responder, Indices(), WithResponder(),
+                                          ArgumentArray());
+        if (responder) {
+            responder->reply(JsonResult<typename std::decay<ReturnValue>::type>::arguments(result));
+        }
+    }
+
+    static QSocketIoResponder responderFor(QSocketIoResponder *responder) {
+        return responder ? *responder : QSocketIoResponder();
+    }
+
+    template <int... I>
+    ReturnValue invoke(const QJsonArray &array, QSocketIoResponder *, IndexList<I...>,
+                       std::false_type, std::false_type) {
+        Q_UNUSED(array);    //for handlers without parameters
+        return m_callback(JsonArgument<typename std::decay<typename ListAt<Parameters, I>::Value>::type>::convert(array.at(I))...);
+    }
+
+    template <int... I>
+    ReturnValue invoke(const QJsonArray &array, QSocketIoResponder *responder, IndexList<I...>,
+                       std::true_type, std::false_type) {
+        Q_UNUSED(array);
+        return m_callback(JsonArgument<typename std::decay<typename ListAt<Parameters, I>::Value>::type>::convert(array.at(I))...,
+                          responderFor(responder));
+    }
+
+    ReturnValue invoke(const QJsonArray &array, QSocketIoResponder *, IndexList<0>,
+                       std::false_type, std::true_type) {
+        return m_callback(array);
+    }
+
+    ReturnValue invoke(const QJsonArray &array, QSocketIoResponder *responder, IndexList<0>,
+                       std::true_type, std::true_type) {
+        return m_callback(array, responderFor(responder));
+    }
+};
+
+namespace QSocketIo
+{
+typedef InplaceCallback<void(const QJsonArray &, QSocketIoResponder *)> Callback;
+typedef InplaceCallback<void(const QString &, const QJsonArray &)> EventCallback;
+typedef InplaceCallback<void(AckError)> ErrorCallback;
+}
+
+//Delivers an event to a slot or invokable method of a QObject, with the
+//given connection type, so that handlers can run in the receiver's thread.
+//The method and the conversion of each parameter are resolved once, when
+//the subscription is made. Parameters of the common JSON types are filled
+//in directly; other types are converted through QVariant. As with typed
+//callbacks, a single QJsonArray parameter receives all arguments. Slots
+//can't reply to the server; the acknowledgement is sent empty.
+class Q_SOCKETIO_EXPORT SlotCallback
+{
+public:
+    enum { MaximumParameters = 10 };    //what QMetaMethod::invoke() takes
+
+    SlotCallback(const QObject *receiver, const QMetaMethod &method, Qt::ConnectionType type);
+
+    void operator()(const QJsonArray &array, QSocketIoResponder *responder) const;
+
+    static QMetaMethod findMethod(const QObject *receiver, const char *member);
+
+private:
+    enum ParameterKind
+    {
+        BoolParameter,
+        IntParameter,
+        LongLongParameter,
+        DoubleParameter,
+        StringParameter,
+        ByteArrayParameter,
+        JsonValueParameter,
+        JsonArrayParameter,
+        JsonObjectParameter,
+        VariantParameter,
+        OtherParameter
+    };
+
+    QPointer<QObject> m_pReceiver;
+    QMetaMethod m_method;
+    Qt::ConnectionType m_type;
+    QVector<ParameterKind> m_parameterKinds;
+    QVector<int> m_parameterTypes;
+    QList<QByteArray> m_parameterNames;
+    bool m_argumentArray;
+};
 
 QT_END_NAMESPACE
 
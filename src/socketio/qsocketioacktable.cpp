@@ -0,0 +1,205 @@
+#include "qsocketioacktable_p.h"
+#include "qcallback.h"
+
+namespace
+{
+int nextPowerOfTwo(int value)
+{
+    int power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+}
+
+QSocketIoAckTable::QSocketIoAckTable() :
+    m_slots(),
+    m_mask(0),
+    m_maximumPending(1024),
+    m_size(0),
+    m_timedCount(0),
+    m_wheelEntries(0),
+    m_clock(),
+    m_processedTick(0)
+{
+    grow(m_maximumPending);
+    for (int i = 0; i < WheelSize; ++i) {
+        //reserved capacity survives resize(), so the buckets stop allocating
+        //once they have reached their working size
+        m_wheel[i].reserve(4);
+    }
+    m_clock.start();
+}
+
+QSocketIoAckTable::~QSocketIoAckTable()
+{
+}
+
+void QSocketIoAckTable::setMaximumPending(int maximum)
+{
+    m_maximumPending = qMax(1, maximum);
+    if (m_maximumPending > m_slots.size()) {
+        grow(m_maximumPending);
+    }
+}
+
+int QSocketIoAckTable::maximumPending() const
+{
+    return m_maximumPending;
+}
+
+int QSocketIoAckTable::size() const
+{
+    return m_size;
+}
+
+bool QSocketIoAckTable::isFull() const
+{
+    return m_size >= m_maximumPending;
+}
+
+bool QSocketIoAckTable::hasTimeouts() const
+{
+    return m_timedCount > 0;
+}
+
+bool QSocketIoAckTable::canInsert(int messageId) const
+{
+    return messageId > 0
+            && m_size < m_maximumPending
+            && m_slots.at(messageId & m_mask).messageId == 0;
+}
+
+//a timeout of zero or less means the entry never expires
+bool QSocketIoAckTable::insert(int messageId, QSocketIo::Callback callback,
+                               QSocketIo::ErrorCallback errorCallback, int timeout,
+                               qint64 emittedAt)
+{
+    if (!canInsert(messageId)) {
+        return false;
+    }
+    Entry &entry = m_slots[messageId & m_mask];
+    entry.messageId = messageId;
+    entry.callback = std::move(callback);
+    entry.errorCallback = std::move(errorCallback);
+    entry.emittedAt = emittedAt;
+    entry.timed = timeout > 0;
+    if (entry.timed) {
+        if (m_timedCount == 0) {
+            //nothing was ticking; don't replay the buckets of the idle time
+            m_processedTick = currentTick();
+        }
+        entry.deadline = currentTick() + (timeout + TickInterval - 1) / TickInterval;
+        m_wheel[entry.deadline & (WheelSize - 1)].append(messageId);
+        ++m_wheelEntries;
+        ++m_timedCount;
+    }
+    ++m_size;
+    return true;
+}
+
+//removes the entry for messageId and hands its callbacks to the caller
+bool QSocketIoAckTable::take(int messageId, Entry *entry)
+{
+    if (messageId <= 0) {
+        return false;
+    }
+    Entry &slot = m_slots[messageId & m_mask];
+    if (slot.messageId != messageId) {
+        return false;
+    }
+    *entry = std::move(slot);
+    release(slot);
+    if (m_timedCount == 0) {
+        //the buckets only hold ids of acknowledged entries now; drop them
+        //so they don't pile up while the wheel is not being advanced
+        clearWheel();
+    }
+    return true;
+}
+
+//advances the wheel to the current time and hands all entries whose
+//deadline has passed to the caller
+void QSocketIoAckTable::expire(QVector<Entry> *expired)
+{
+    const qint64 now = currentTick();
+    qint64 tick = m_processedTick + 1;
+    if (now - tick >= WheelSize) {
+        //a full revolution visits every bucket once
+        tick = now - WheelSize + 1;
+    }
+    for (; tick <= now && m_timedCount > 0; ++tick) {
+        QVector<int> &bucket = m_wheel[tick & (WheelSize - 1)];
+        int kept = 0;
+        for (int i = 0; i < bucket.size(); ++i) {
+            const int messageId = bucket.at(i);
+            Entry &slot = m_slots[messageId & m_mask];
+            if (slot.messageId != messageId || !slot.timed) {
+                continue;   //already acknowledged
+            }
+            if (slot.deadline <= now) {
+                expired->append(slot);
+                release(slot);
+            } else {
+                bucket[kept++] = messageId;
+            }
+        }
+        m_wheelEntries -= bucket.size() - kept;
+        bucket.resize(kept);
+    }
+    if (m_timedCount == 0) {
+        clearWheel();
+    }
+    m_processedTick = now;
+}
+
+void QSocketIoAckTable::takeAll(QVector<Entry> *entries)
+{
+    for (int i = 0; i < m_slots.size() && m_size > 0; ++i) {
+        Entry &slot = m_slots[i];
+        if (slot.messageId != 0) {
+            entries->append(slot);
+            release(slot);
+        }
+    }
+    clearWheel();
+}
+
+//the table only grows: ids that are distinct modulo the old capacity stay
+//distinct modulo a larger power of two
+void QSocketIoAckTable::grow(int capacity)
+{
+    QVector<Entry> table(nextPowerOfTwo(capacity));
+    const int mask = table.size() - 1;
+    for (int i = 0; i < m_slots.size(); ++i) {
+        Entry &entry = m_slots[i];
+        if (entry.messageId != 0) {
+            table[entry.messageId & mask] = std::move(entry);
+        }
+    }
+    m_slots.swap(table);
+    m_mask = mask;
+}
+
+void QSocketIoAckTable::release(Entry &entry)
+{
+    if (entry.timed) {
+        --m_timedCount;
+    }
+    --m_size;
+    entry = Entry();
+}
+
+void QSocketIoAckTable::clearWheel()
+{
+    for (int i = 0; i < WheelSize && m_wheelEntries > 0; ++i) {
+        m_wheelEntries -= m_wheel[i].size();
+        m_wheel[i].resize(0);
+    }
+}
+
+qint64 QSocketIoAckTable::currentTick() const
+{
+    return m_clock.elapsed() / TickInterval;
+}
@@ -0,0 +1,86 @@
+#ifndef QSOCKETIOACKTABLE_P_H
+#define QSOCKETIOACKTABLE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QVector>
+#include <QtCore/QElapsedTimer>
+#include "qcallback.h"
+
+QT_BEGIN_NAMESPACE
+
+//Pending acknowledgements, stored in a slot map indexed by message id.
+//Message ids are handed out sequentially, so the low bits of the id select
+//the slot; an id whose slot is still taken is refused, which bounds the
+//table and applies backpressure. Timeouts are tracked on a single hashed
+//timer wheel that is advanced by expire().
+class QSocketIoAckTable
+{
+public:
+    enum { TickInterval = 10 };     //milliseconds per wheel tick
+
+    struct Entry
+    {
+        Entry() :
+            messageId(0), timed(false), deadline(0), emittedAt(0),
+            callback(), errorCallback()
+        {}
+
+        int messageId;      //0 marks a free slot
+        bool timed;
+        qint64 deadline;    //in ticks
+        qint64 emittedAt;   //for the metrics; 0 when they are off
+        QSocketIo::Callback callback;
+        QSocketIo::ErrorCallback errorCallback;
+    };
+
+    QSocketIoAckTable();
+    ~QSocketIoAckTable();
+
+    void setMaximumPending(int maximum);
+    int maximumPending() const;
+
+    int size() const;
+    bool isFull() const;
+    bool hasTimeouts() const;
+    bool canInsert(int messageId) const;
+
+    bool insert(int messageId, QSocketIo::Callback callback,
+                QSocketIo::ErrorCallback errorCallback, int timeout, qint64 emittedAt = 0);
+    bool take(int messageId, Entry *entry);
+    void expire(QVector<Entry> *expired);
+    void takeAll(QVector<Entry> *entries);
+
+private:
+    Q_DISABLE_COPY(QSocketIoAckTable)
+
+    enum { WheelSize = 256 };
+
+    QVector<Entry> m_slots;
+    int m_mask;
+    int m_maximumPending;
+    int m_size;
+    int m_timedCount;
+    QVector<int> m_wheel[WheelSize];
+    int m_wheelEntries;
+    QElapsedTimer m_clock;
+    qint64 m_processedTick;
+
+    void grow(int capacity);
+    void release(Entry &entry);
+    void clearWheel();
+    qint64 currentTick() const;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOACKTABLE_P_H
@@ -0,0 +1,68 @@
+#include "qsocketioattachments_p.h"
+#include "qcallback.h"
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+
+namespace
+{
+thread_local const QVector<QByteArray> *currentAttachments = Q_NULLPTR;
+}
+
+QSocketIoAttachmentScope::QSocketIoAttachmentScope(const QVector<QByteArray> *attachments) :
+    m_pPrevious(currentAttachments)
+{
+    currentAttachments = attachments;
+}
+
+QSocketIoAttachmentScope::~QSocketIoAttachmentScope()
+{
+    currentAttachments = m_pPrevious;
+}
+
+//counts the placeholders in arrays and objects at any depth, but stops
+//past limit
+int qSocketIoPlaceholderCount(const QJsonValue &value, int limit)
+{
+    if (QSocketIo::isAttachment(value)) {
+        return 1;
+    }
+    int count = 0;
+    if (value.isArray()) {
+        const QJsonArray array = value.toArray();
+        for (int i = 0; i < array.size() && count <= limit; ++i) {
+            count += qSocketIoPlaceholderCount(array.at(i), limit - count);
+        }
+    } else if (value.isObject()) {
+        const QJsonObject object = value.toObject();
+        for (QJsonObject::const_iterator it = object.constBegin();
+             it != object.constEnd() && count <= limit; ++it) {
+            count += qSocketIoPlaceholderCount(it.value(), limit - count);
+        }
+    }
+    return count;
+}
+
+//{"_placeholder":true,"num":<index>}, as socket.io 1.x writes them
+bool QSocketIo::isAttachment(const QJsonValue &value)
+{
+    if (!value.isObject()) {
+        return false;
+    }
+    const QJsonObject object = value.toObject();
+    return object.size() == 2
+            && object.value(QStringLiteral("_placeholder")).toBool()
+            && object.value(QStringLiteral("num")).isDouble();
+}
+
+//the attachment shares its data with the received message
+QByteArray QSocketIo::toByteArray(const QJsonValue &value)
+{
+    if (isAttachment(value)) {
+        const int index = value.toObject().value(QStringLiteral("num")).toInt(-1);
+        if (currentAttachments && index >= 0 && index < currentAttachments->size()) {
+            return currentAttachments->at(index);
+        }
+        return QByteArray();
+    }
+    return value.toString().toUtf8();
+}
@@ -0,0 +1,39 @@
+#ifndef QSOCKETIOATTACHMENTS_P_H
+#define QSOCKETIOATTACHMENTS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+#include <QtCore/QJsonValue>
+
+QT_BEGIN_NAMESPACE
+
+//Makes the attachments of an event available to QSocketIo::toByteArray()
+//in the current thread while the handlers of the event run. Scopes nest.
+class QSocketIoAttachmentScope
+{
+public:
+    explicit QSocketIoAttachmentScope(const QVector<QByteArray> *attachments);
+    ~QSocketIoAttachmentScope();
+
+private:
+    Q_DISABLE_COPY(QSocketIoAttachmentScope)
+
+    const QVector<QByteArray> *m_pPrevious;
+};
+
+int qSocketIoPlaceholderCount(const QJsonValue &value, int limit);
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOATTACHMENTS_P_H
@@ -1,82 +1,618 @@
 #include "qsocketioclient.h"
+#include "qsocketioframeparser.h"
+#include "qsocketioframewriter_p.h"
+#include "qsocketiometrics_p.h"
+#include "qsocketiotrace_p.h"
+#include "qsocketiompscqueue_p.h"
+#include "qsocketiothreading_p.h"
+#include "qsocketiojournal_p.h"
+#include "qsocketiodeflate_p.h"
+#include "qsocketioattachments_p.h"
 #include <QtWebSockets/QWebSocket>
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QHostAddress>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QDateTime>
 #include <QtCore/QTimer>
-#include <QtCore/QRegExp>
+#include <QtCore/QThread>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutexLocker>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
 #include <QtCore/QDebug>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QtCore/QRandomGenerator>
+#endif
 #include <functional>
+#include <limits>
+#include <random>
+
+namespace
+{
+//uniformly distributed in [0, 1)
+double randomUnit()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    return QRandomGenerator::global()->generateDouble();
+#else
+    //only used to schedule reconnects, so the cost of the device is fine;
+    //a seeded generator would be shared state between threads
+    std::random_device device;
+    return std::uniform_real_distribution<double>(0.0, 1.0)(device);
+#endif
+}
+
+//as long as QHostInfo keeps a lookup in its own cache, which the handshake
+//and the WebSocket resolve through as well
+const qint64 HostCacheTime = 60000;
+
+//per event; the count comes from the server, and decides what is reserved
+const int MaximumAttachments = 1024;
+
+//what a held frame counts against the watermarks
+qint64 heldSize(const QByteArray &frame, const QVector<QByteArray> &attachments)
+{
+    qint64 size = frame.size();
+    for (int i = 0; i < attachments.size(); ++i) {
+        size += attachments.at(i).size();
+    }
+    return size;
+}
+
+//the path the client was opened with, to put the socket.io paths under
+QString basePath(const QUrl &url)
+{
+    QString path = url.path();
+    if (path.endsWith(QLatin1Char('/'))) {
+        path.chop(1);
+    }
+    return path;
+}
+
+//what a text message of payloadBytes takes on the wire as a single masked
+//WebSocket frame; larger messages are split into more frames and slightly
+//underestimated, which errs on the side of releasing the queue early
+qint64 wireSize(qint64 payloadBytes)
+{
+    qint64 header = 2 + 4;
+    if (payloadBytes > 0xffff) {
+        header += 8;
+    } else if (payloadBytes > 125) {
+        header += 2;
+    }
+    return payloadBytes + header;
+}
+}
 
 QSocketIoClient::QSocketIoClient(QObject *parent) :
-    QObject(parent),
-    m_pWebSocket(new QWebSocket()),
-    m_pNetworkAccessManager(new QNetworkAccessManager()),
+    QSocketIoNamespace(this, QString(), parent),
+    //everything the client owns is parented to it, so that it moves along
+    //to the I/O thread
+    m_pWebSocket(new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this)),
+    m_pNetworkAccessManager(new QNetworkAccessManager(this)),
+    m_ownsNetworkAccessManager(true),
     m_requestUrl(),
     m_connectionTimeout(30000),
     m_heartBeatTimeout(20000),
-    m_pHeartBeatTimer(new QTimer()),
-    m_sessionId()
+    m_pHeartBeatTimer(new QTimer(this)),
+    m_lastHeartBeatSent(),
+    m_pLivenessTimer(new QTimer(this)),
+    m_lastReceived(),
+    m_sessionId(),
+    m_connected(false),
+    m_namespaces(),
+    m_lastMessageId(0),
+    m_pFrameWriter(new QSocketIoFrameWriter()),
+    m_batchingEnabled(false),
+    m_multiPacketFramingEnabled(false),
+    m_batchMaximumPackets(64),
+    m_batchMaximumBytes(64 * 1024),
+    m_batchFlushInterval(1000),
+    m_pFlushTimer(new QTimer(this)),
+    m_batchBuffer(),
+    m_batchOffsets(),
+    m_framedBuffer(),
+    m_batchAge(),
+    m_flushStatistics(),
+    m_compressionEnabled(false),
+    m_compressionThreshold(256),
+    m_pDeflate(Q_NULLPTR),
+    m_compressionStatistics(),
+    m_pHandshakeReply(Q_NULLPTR),
+    m_handshakeStarted(),
+    m_handshakePending(false),
+    m_hostLookupId(-1),
+    m_hostLookedUp(),
+    m_phaseStarted(),
+    m_connectTimings(),
+#ifndef QT_NO_SSL
+    m_sslConfiguration(QSslConfiguration::defaultConfiguration()),
+#endif
+    m_pMetrics(Q_NULLPTR),
+    m_pMetricsStorage(Q_NULLPTR),
+    m_closed(false),
+    m_reconnectionEnabled(true),
+    m_reconnectionAttempts(-1),
+    m_reconnectionDelay(1000),
+    m_reconnectionDelayMaximum(30000),
+    m_randomizationFactor(0.5),
+    m_reconnectAttempt(0),
+    m_pReconnectTimer(new QTimer(this)),
+    m_reconnectBufferSize(1024),
+    m_reconnectBuffer(),
+    m_pJournal(Q_NULLPTR),
+    m_journalMaximumSize(64 * 1024 * 1024),
+    m_journalEvictionPolicy(EvictOldestPolicy),
+    m_journalSyncInterval(50),
+    m_pJournalSyncTimer(new QTimer(this)),
+    m_journalSequences(),
+    m_highWatermarkBytes(4 * 1024 * 1024),
+    m_highWatermarkMessages(4096),
+    m_lowWatermarkBytes(1024 * 1024),
+    m_lowWatermarkMessages(1024),
+    m_overflowPolicy(BlockPolicy),
+    m_heldFrames(),
+    m_heldBytes(0),
+    m_heldSequence(0),
+    m_heldVolatile(),
+    m_batchVolatile(),
+    m_writtenFrames(),
+    m_writtenBytes(0),
+    m_writtenCredit(0),
+    m_congested(0),
+    m_congestionMutex(),
+    m_writableCondition(),
+    m_pIoThread(Q_NULLPTR),
+    m_ownsIoThread(false),
+    m_pOutbound(new QSocketIoMpscQueue<QSocketIoOutbound>()),
+    m_outboundWakeup(0),
+    m_pCallbackReceiver(Q_NULLPTR),
+    m_callbackThreadSet(false)
 {
-    m_pHeartBeatTimer->setInterval(m_heartBeatTimeout);
+    //both timers are re-armed lazily for the time that is left, so traffic
+    //only has to restart an elapsed timer instead of a QTimer
+    m_pHeartBeatTimer->setSingleShot(true);
+    m_pLivenessTimer->setSingleShot(true);
+    m_pFlushTimer->setSingleShot(true);
+    m_pFlushTimer->setTimerType(Qt::PreciseTimer);
+    //reserved capacity survives resize(0), so batches reuse their buffers
+    m_batchBuffer.reserve(4096);
+    m_batchOffsets.reserve(m_batchMaximumPackets);
+    m_framedBuffer.reserve(4096);
+    m_pReconnectTimer->setSingleShot(true);
+    m_pJournalSyncTimer->setSingleShot(true);
+#ifndef QT_NO_SSL
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+#endif
 
     connect(m_pWebSocket, SIGNAL(error(QAbstractSocket::SocketError)),
             this, SLOT(onError(QAbstractSocket::SocketError)));
+    connect(m_pWebSocket, SIGNAL(connected()), this, SLOT(onWebSocketConnected()));
+    connect(m_pWebSocket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
     connect(m_pWebSocket, SIGNAL(textMessageReceived(QString)),
             this, SLOT(onMessage(QString)));
-
-    connect(m_pNetworkAccessManager, SIGNAL(finished(QNetworkReply*)),
-            this, SLOT(replyFinished(QNetworkReply*)));
+    connect(m_pWebSocket, SIGNAL(binaryMessageReceived(QByteArray)),
+            this, SLOT(onBinaryMessage(QByteArray)));
+    connect(m_pWebSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten(qint64)));
 
     connect(m_pHeartBeatTimer, SIGNAL(timeout()), this, SLOT(sendHeartBeat()));
+    connect(m_pLivenessTimer, SIGNAL(timeout()), this, SLOT(onLivenessTimeout()));
+    connect(m_pFlushTimer, SIGNAL(timeout()), this, SLOT(onFlushTimeout()));
+    connect(m_pReconnectTimer, SIGNAL(timeout()), this, SLOT(reconnect()));
+    connect(m_pJournalSyncTimer, SIGNAL(timeout()), this, SLOT(syncJournal()));
 }
 
 QSocketIoClient::~QSocketIoClient()
 {
+    QThread *ioThread = m_pIoThread.loadAcquire();
+    if (ioThread && QThread::currentThread() == ioThread) {
+        //deleted from within its own event loop; the thread can only end
+        //after this returns, and a shared one goes on without the client
+        if (m_ownsIoThread) {
+            ioThread->quit();
+            connect(ioThread, SIGNAL(finished()), ioThread, SLOT(deleteLater()));
+        }
+        m_pIoThread.storeRelease(Q_NULLPTR);
+    } else {
+        stopIoThread();
+    }
+    //tear down the namespaces while the client is still whole
+    qDeleteAll(m_namespaces);
+    m_namespaces.clear();
+    clearCallbacks();
     m_pHeartBeatTimer->stop();
     delete m_pHeartBeatTimer;
+    m_pLivenessTimer->stop();
+    delete m_pLivenessTimer;
+    m_pFlushTimer->stop();
+    delete m_pFlushTimer;
+    m_pReconnectTimer->stop();
+    delete m_pReconnectTimer;
+    //closing syncs what was not synced yet
+    delete m_pJournal;
+    m_pJournalSyncTimer->stop();
+    delete m_pJournalSyncTimer;
     delete m_pWebSocket;
-    delete m_pNetworkAccessManager;
+    if (m_ownsNetworkAccessManager) {
+        delete m_pNetworkAccessManager;
+    }
+    delete m_pFrameWriter;
+    delete m_pDeflate;
+    delete m_pOutbound;
+    delete m_pMetricsStorage.loadAcquire();
+    if (m_pCallbackReceiver) {
+        //it may live in another thread, with callbacks still on their way
+        m_pCallbackReceiver->deleteLater();
+    }
 }
 
 bool QSocketIoClient::open(const QUrl &url)
 {
+    if (mustQueue()) {
+        runOnIoThread([this, url]() {
+            open(url);
+        });
+        return true;
+    }
     m_requestUrl = url;
-    QUrl requestUrl(QStringLiteral("http://%1:%2/socket.io/1/?t=%3")
-                    .arg(url.host())
-                    .arg(QString::number(url.port(80)))
-                    .arg(QString::number(QDateTime::currentMSecsSinceEpoch())));
-    QNetworkRequest request(requestUrl);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("text/html"));
-    request.setRawHeader(QByteArrayLiteral("Accept"), QByteArrayLiteral("*/*"));
-    request.setRawHeader(QByteArrayLiteral("Connection"), QByteArrayLiteral("close"));
-    m_pNetworkAccessManager->post(request, QByteArray());
+    m_closed = false;
+    m_reconnectAttempt = 0;
+    m_pReconnectTimer->stop();
+    handshake();
+    return true;
+}
+
+//disconnects from the server and stops reconnecting; emits that could not
+//be sent yet are dropped and pending acks fail with AckConnectionLostError
+void QSocketIoClient::close()
+{
+    if (mustQueue()) {
+        runOnIoThread([this]() {
+            close();
+        });
+        return;
+    }
+    m_closed = true;
+    m_pReconnectTimer->stop();
+    abortHostLookup();
+    m_handshakePending = false;
+    if (m_pHandshakeReply) {
+        QNetworkReply *reply = m_pHandshakeReply;
+        m_pHandshakeReply = Q_NULLPTR;
+        reply->abort();
+    }
+    if (m_connected) {
+        sendFrame(QByteArrayLiteral("0::"));
+        flushBatch(ExplicitFlush);
+    }
+    connectionLost(false);
+    m_pWebSocket->close();
+}
+
+bool QSocketIoClient::isSecure() const
+{
+    const QString scheme = m_requestUrl.scheme();
+    return scheme == QLatin1String("wss") || scheme == QLatin1String("https");
+}
+
+//both urls keep the host, port and path of the url that was opened; ws and
+//http map to one another, as do wss and https
+QUrl QSocketIoClient::handshakeUrl() const
+{
+    QUrl url;
+    url.setScheme(isSecure() ? QStringLiteral("https") : QStringLiteral("http"));
+    url.setHost(m_requestUrl.host());
+    url.setPort(m_requestUrl.port(isSecure() ? 443 : 80));
+    url.setPath(basePath(m_requestUrl) + QStringLiteral("/socket.io/1/"));
+    url.setQuery(QStringLiteral("t=") % QString::number(QDateTime::currentMSecsSinceEpoch()));
+    return url;
+}
+
+QUrl QSocketIoClient::webSocketUrl() const
+{
+    QUrl url;
+    url.setScheme(isSecure() ? QStringLiteral("wss") : QStringLiteral("ws"));
+    url.setHost(m_requestUrl.host());
+    url.setPort(m_requestUrl.port(isSecure() ? 443 : 80));
+    url.setPath(basePath(m_requestUrl) + QStringLiteral("/socket.io/1/websocket/") % m_sessionId);
+    return url;
+}
+
+//resolves the host into QHostInfo's cache unless it is an address or was
+//resolved a moment ago; returns whether a lookup is running
+bool QSocketIoClient::lookupHost()
+{
+    if (m_hostLookupId >= 0) {
+        return true;
+    }
+    const QString host = m_requestUrl.host();
+    if (host.isEmpty() || !QHostAddress(host).isNull()
+            || (m_hostLookedUp.isValid() && m_hostLookedUp.elapsed() < HostCacheTime)) {
+        return false;
+    }
+    m_hostLookupId = QHostInfo::lookupHost(host, this, SLOT(onHostLookedUp(QHostInfo)));
     return true;
 }
 
+void QSocketIoClient::abortHostLookup()
+{
+    if (m_hostLookupId >= 0) {
+        QHostInfo::abortHostLookup(m_hostLookupId);
+        m_hostLookupId = -1;
+    }
+}
+
+void QSocketIoClient::onHostLookedUp(QHostInfo info)
+{
+    if (info.lookupId() != m_hostLookupId) {
+        return;
+    }
+    m_hostLookupId = -1;
+    if (info.error() == QHostInfo::NoError) {
+        m_hostLookedUp.start();
+    }
+    if (m_handshakePending) {
+        //a failed lookup fails the handshake, which reports it
+        m_connectTimings.lookup = m_phaseStarted.nsecsElapsed() / 1000;
+        postHandshake();
+    }
+}
+
+void QSocketIoClient::handshake()
+{
+    if (m_pHandshakeReply) {
+        QNetworkReply *reply = m_pHandshakeReply;
+        m_pHandshakeReply = Q_NULLPTR;
+        reply->abort();
+    }
+    m_handshakeStarted.start();
+    m_phaseStarted.start();
+    m_connectTimings = QSocketIoConnectTimings();
+    m_handshakePending = true;
+    if (!lookupHost()) {
+        postHandshake();
+    }
+}
+
+//a GET like the JavaScript client's, over a connection that is kept alive:
+//the manager reuses it for the next handshake to the same host, also for
+//the other clients of a pool
+void QSocketIoClient::postHandshake()
+{
+    m_handshakePending = false;
+    m_phaseStarted.start();
+    QNetworkRequest request(handshakeUrl());
+    request.setRawHeader(QByteArrayLiteral("Accept"), QByteArrayLiteral("*/*"));
+#ifndef QT_NO_SSL
+    if (isSecure()) {
+        request.setSslConfiguration(m_sslConfiguration);
+    }
+#endif
+    m_pHandshakeReply = m_pNetworkAccessManager->get(request);
+    //the manager may be shared with other clients, so only this reply counts
+    connect(m_pHandshakeReply, SIGNAL(finished()), this, SLOT(onHandshakeFinished()));
+}
+
 void QSocketIoClient::onError(QAbstractSocket::SocketError error)
 {
     qDebug() << "Error occurred: " << error;
+    connectionLost(true);
+}
+
+void QSocketIoClient::onDisconnected()
+{
+    connectionLost(true);
+}
+
+void QSocketIoClient::reconnect()
+{
+    handshake();
+}
+
+//called for every way the connection can go away; a socket error is usually
+//followed by disconnected(), so this must be idempotent
+void QSocketIoClient::connectionLost(bool recoverable)
+{
+    const bool wasConnected = m_connected;
+    m_connected = false;
+    m_pHeartBeatTimer->stop();
+    m_pLivenessTimer->stop();
+    discardBatch();
+    resetOutboundQueue();
+    //the journal replays what was not acknowledged on the next connect
+    m_journalSequences.clear();
+    m_binaryEvent = BinaryEvent();
+    if (wasConnected) {
+        abortAllPendingAcks();
+        for (QHash<QString, QSocketIoNamespace *>::const_iterator it = m_namespaces.constBegin();
+             it != m_namespaces.constEnd(); ++it) {
+            Q_EMIT(it.value()->disconnected(it.key()));
+            Q_EMIT(disconnected(it.key()));
+        }
+        Q_EMIT(disconnected(QString()));
+    }
+
+    //a slot connected to disconnected() may have called open() or close()
+    if (m_pReconnectTimer->isActive() || m_pHandshakeReply || m_handshakePending
+            || m_connected) {
+        return;
+    }
+    if (!m_closed && recoverable && m_reconnectionEnabled
+            && (m_reconnectionAttempts < 0 || m_reconnectAttempt < m_reconnectionAttempts)) {
+        const int delay = nextReconnectDelay();
+        ++m_reconnectAttempt;
+        m_pReconnectTimer->start(delay);
+        //resolve the host while waiting, so the handshake doesn't have to
+        lookupHost();
+        Q_EMIT(reconnecting(m_reconnectAttempt, delay));
+        return;
+    }
+
+    const bool gaveUp = !m_closed && recoverable && m_reconnectionEnabled;
+    m_closed = true;
+    m_reconnectBuffer.clear();
+    abortAllPendingAcks();
+    if (gaveUp) {
+        Q_EMIT(reconnectFailed());
+    }
+}
+
+//exponential backoff as in socket.io-client: the delay doubles with every
+//attempt up to the maximum, and is then spread by +-randomizationFactor so
+//that the clients of a restarted server don't all come back at once. The
+//maximum applies before the spread, otherwise clients would bunch up there.
+int QSocketIoClient::nextReconnectDelay() const
+{
+    qint64 delay = m_reconnectionDelay;
+    for (int i = 0; i < m_reconnectAttempt && delay < m_reconnectionDelayMaximum; ++i) {
+        delay *= 2;
+    }
+    delay = qMin(delay, qint64(m_reconnectionDelayMaximum));
+    const double deviation = (randomUnit() * 2.0 - 1.0) * m_randomizationFactor;
+    return int(qMax(qint64(0), delay + qint64(deviation * delay)));
+}
+
+void QSocketIoClient::abortAllPendingAcks()
+{
+    abortPendingAcks(QSocketIo::AckConnectionLostError);
+    for (QHash<QString, QSocketIoNamespace *>::const_iterator it = m_namespaces.constBegin();
+         it != m_namespaces.constEnd(); ++it) {
+        it.value()->abortPendingAcks(QSocketIo::AckConnectionLostError);
+    }
 }
 
 void QSocketIoClient::onMessage(QString textMessage)
 {
-    Q_UNUSED(textMessage);
-    parseMessage(textMessage);
+    QSOCKETIO_TRACE_SPAN("receive");
+    //QWebSocket only hands out text frames as QString; encode them once and
+    //parse everything else in place on the UTF-8 bytes
+    m_lastReceived.start();
+    receivePayload(textMessage.toUtf8());
+}
+
+//binary messages are the attachments of the last event while it is waiting
+//for them, and compressed text messages otherwise
+void QSocketIoClient::onBinaryMessage(QByteArray message)
+{
+    QSOCKETIO_TRACE_SPAN("receive");
+    m_lastReceived.start();
+    if (m_binaryEvent.expected > 0) {
+        receiveAttachment(message);
+        return;
+    }
+    if (!m_pDeflate) {
+        qWarning() << "Compressed message received, but compression is not enabled";
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray *payload = m_pDeflate->decompress(message);
+    if (!payload) {
+        qWarning() << "Cannot decompress message, or it is larger than"
+                   << m_pDeflate->maximumDecompressedSize() << "bytes; dropping the connection";
+        if (m_pMetrics) {
+            m_pMetrics->recordParseError();
+        }
+        //the window is out of step with the server's from here on
+        connectionLost(true);
+        m_pWebSocket->abort();
+        return;
+    }
+    m_compressionStatistics.decompressionTime += quint64(timer.nsecsElapsed());
+    ++m_compressionStatistics.messagesDecompressed;
+    m_compressionStatistics.bytesBeforeDecompression += quint64(message.size());
+    m_compressionStatistics.bytesAfterDecompression += quint64(payload->size());
+    receivePayload(*payload);
+}
+
+void QSocketIoClient::receivePayload(const QByteArray &payload)
+{
+    if (m_binaryEvent.expected > 0) {
+        qWarning() << "Event" << m_binaryEvent.message << "is missing"
+                   << m_binaryEvent.expected - m_binaryEvent.attachments.size() << "attachments";
+        if (m_pMetrics) {
+            m_pMetrics->recordParseError();
+        }
+        m_binaryEvent = BinaryEvent();
+    }
+    if (QSocketIoFrameParser::isFramedPayload(payload)) {
+        int position = 0;
+        QByteArray packet;
+        while (QSocketIoFrameParser::readFramedPacket(payload, &position, &packet)) {
+            parseMessage(packet);
+        }
+        if (position != payload.size()) {
+            qWarning() << "Malformed framed payload at offset" << position;
+            if (m_pMetrics) {
+                m_pMetrics->recordParseError();
+            }
+        }
+    } else {
+        parseMessage(payload);
+    }
 }
 
+//socket.io 0.9 servers only count heartbeat packets as a sign of life, so
+//other outbound traffic can't stand in for one; a heartbeat is only sent
+//when no reply to a server heartbeat went out within the interval
 void QSocketIoClient::sendHeartBeat()
 {
-    (void)m_pWebSocket->sendTextMessage(QStringLiteral("2::"));
+    const qint64 remaining = m_heartBeatTimeout - m_lastHeartBeatSent.elapsed();
+    if (m_lastHeartBeatSent.isValid() && remaining > 0) {
+        m_pHeartBeatTimer->start(int(remaining));
+        return;
+    }
+    writeHeartBeat();
+    m_pHeartBeatTimer->start(m_heartBeatTimeout);
+}
+
+void QSocketIoClient::writeHeartBeat()
+{
+    sendControlFrame(QByteArrayLiteral("2::"));
+    m_lastHeartBeatSent.start();
+}
+
+//any inbound packet proves the server is alive; when nothing arrived within
+//the close timeout the connection is half open or the server is gone
+void QSocketIoClient::onLivenessTimeout()
+{
+    const qint64 remaining = m_connectionTimeout - m_lastReceived.elapsed();
+    if (remaining > 0) {
+        m_pLivenessTimer->start(int(remaining));
+        return;
+    }
+    qWarning() << "Nothing received for" << m_connectionTimeout << "ms; connection is dead";
+    connectionLost(true);
+    m_pWebSocket->abort();
+}
+
+void QSocketIoClient::onHandshakeFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (reply) {
+        handshakeFinished(reply);
+    }
 }
 
-void QSocketIoClient::replyFinished(QNetworkReply *reply)
+void QSocketIoClient::handshakeFinished(QNetworkReply *reply)
 {
+    reply->deleteLater();
+    if (reply != m_pHandshakeReply) {
+        return;     //aborted
+    }
+    m_pHandshakeReply = Q_NULLPTR;
+    m_connectTimings.handshake = m_phaseStarted.nsecsElapsed() / 1000;
+#ifndef QT_NO_SSL
+    if (isSecure() && reply->error() == QNetworkReply::NoError) {
+        //holds the session ticket, which the WebSocket and the next
+        //handshake resume the TLS session with
+        m_sslConfiguration = reply->sslConfiguration();
+    }
+#endif
+
     int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     //QString statusReason = reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString();
     switch (status)
@@ -89,6 +625,7 @@ void QSocketIoClient::replyFinished(QNetworkReply *reply)
             if (handshakeReturn.length() != 4)
             {
                 qDebug() << "Not a valid handshake return";
+                connectionLost(true);
             }
             else
             {
@@ -96,12 +633,11 @@ void QSocketIoClient::replyFinished(QNetworkReply *reply)
                 m_heartBeatTimeout = handshakeReturn[1].toInt() * 1000 - 500;
                 m_connectionTimeout = handshakeReturn[2].toInt() * 1000;
 
-                m_pHeartBeatTimer->setInterval(m_heartBeatTimeout);
-
                 QStringList protocols = handshakeReturn[3].split(",");
                 if (!protocols.contains("websocket"))
                 {
                     qDebug() << "websockets not supported; so cannot continue";
+                    connectionLost(false);
                     return;
                 }
                 m_sessionId = sessionId;
@@ -115,12 +651,14 @@ void QSocketIoClient::replyFinished(QNetworkReply *reply)
             //the server refuses to authorize the client to connect,
             //based on the supplied information (eg: Cookie header or custom query components).
             qDebug() << "Error:" << reply->readAll();
+            connectionLost(false);
             break;
         }
 
         case 500:	//internal server error
         {
             qDebug() << "Error:" << reply->readAll();
+            connectionLost(true);
             break;
         }
 
@@ -133,116 +671,193 @@ void QSocketIoClient::replyFinished(QNetworkReply *reply)
         {
             //the server refuses the connection for any reason (e.g. overload)
             qDebug() << "Error:" << reply->readAll();
+            connectionLost(true);
             break;
         }
 
         default:
         {
+            //includes network errors, which have no status code
+            connectionLost(true);
         }
     }
 }
 
 void QSocketIoClient::handshakeSucceeded()
 {
-    QUrl url(m_requestUrl.toString() + QStringLiteral("/socket.io/1/websocket/") % m_sessionId);
-    m_pWebSocket->open(url, true);
+#ifndef QT_NO_SSL
+    if (isSecure()) {
+        m_pWebSocket->setSslConfiguration(m_sslConfiguration);
+    }
+#endif
+    if (m_pDeflate) {
+        //the server starts with empty windows on the new connection
+        m_pDeflate->reset();
+    }
+    m_phaseStarted.start();
+    m_pWebSocket->open(webSocketUrl(), true);
 }
 
-void QSocketIoClient::ackReceived(int messageId, QJsonArray arguments)
+void QSocketIoClient::onWebSocketConnected()
 {
-    QAbstractCallback *callback = m_callbacks.value(messageId, Q_NULLPTR);
-    if (callback) {
-        (*callback)(arguments);
-        delete callback;
-    }
+    m_connectTimings.upgrade = m_phaseStarted.nsecsElapsed() / 1000;
+    m_phaseStarted.start();
 }
 
-#include <functional>
-
-void QSocketIoClient::eventReceived(QString message, QJsonArray arguments,
-                                    bool mustAck, int messageId)
+//the attachment shares its data with the message it came in
+void QSocketIoClient::receiveAttachment(const QByteArray &attachment)
 {
-    if (m_subscriptions.contains(message)) {
-        QJsonValue retVal;
-        QAbstractCallback *callback = m_subscriptions[message];
-        /*if (callback->hasReturnValue()) {
-            retVal = (*callback)(arguments);
-        } else {*/
-            (*callback)(arguments);
-        //}
-        if (mustAck) {
-            acknowledge(messageId, retVal);
-        }
+    m_binaryEvent.attachments.append(attachment);
+    if (m_binaryEvent.attachments.size() < m_binaryEvent.expected) {
+        return;
     }
+    BinaryEvent event;
+    qSwap(event, m_binaryEvent);
+    event.target->eventReceived(event.message, event.arguments, event.mustAck,
+                                event.messageId, event.attachments);
 }
 
-void QSocketIoClient::parseMessage(const QString &message)
+void QSocketIoClient::parseMessage(const QByteArray &message)
 {
-    QRegExp regExp("^([^:]+):([0-9]+)?(\\+)?:([^:]+)?:?([\\s\\S]*)?$", Qt::CaseInsensitive,
-                   QRegExp::RegExp2);
-    if (regExp.indexIn(message) != -1)
+    QSOCKETIO_TRACE_SPAN("parseMessage");
+    QSocketIoFrameParser parser;
+    const bool parsed = parser.parse(message);
+    if (m_pMetrics)
+    {
+        if (parsed)
+        {
+            m_pMetrics->recordReceived(parser.packetType(), message.size());
+        }
+        else
+        {
+            m_pMetrics->recordParseError();
+        }
+    }
+    if (parsed)
     {
-        QStringList captured = regExp.capturedTexts();
-        int messageType = captured.at(1).toInt();
-        int messageId = captured.at(2).toInt();
+        int messageId = parser.messageId();
         bool mustAck = (messageId != 0);
-        bool autoAck = mustAck && captured.at(3).isEmpty();
-        QString endpoint = captured.at(4);
-        QString data = captured.at(5);
+        bool autoAck = mustAck && !parser.isDataAck();
+        QByteArray endpoint = parser.endpoint();
+        QByteArray data = parser.data();
+        QSocketIoNamespace *target = namespaceFor(endpoint);
 
         if (autoAck)
         {
-            acknowledge(messageId);
+            target->acknowledge(messageId);
         }
 
-        switch(messageType)
+        switch(parser.packetType())
         {
-            case 0:	//disconnect
+            case QSocketIoFrameParser::DisconnectPacket:
             {
-                Q_EMIT(disconnected(endpoint));
+                if (endpoint.isEmpty())
+                {
+                    //the server closed the session on purpose; like the
+                    //JavaScript client, don't reconnect
+                    connectionLost(false);
+                    break;
+                }
+                const QString endpointName = QString::fromUtf8(endpoint);
+                if (target != this)
+                {
+                    Q_EMIT(target->disconnected(endpointName));
+                }
+                Q_EMIT(disconnected(endpointName));
                 break;
             }
-            case 1: //connect
+            case QSocketIoFrameParser::ConnectPacket:
             {
-                m_pHeartBeatTimer->start();
-                Q_EMIT(connected(endpoint));
+                const QString endpointName = QString::fromUtf8(endpoint);
+                if (endpoint.isEmpty())
+                {
+                    if (m_handshakeStarted.isValid())
+                    {
+                        m_connectTimings.session = m_phaseStarted.nsecsElapsed() / 1000;
+                        m_connectTimings.total = m_handshakeStarted.nsecsElapsed() / 1000;
+                        if (m_pMetrics)
+                        {
+                            m_pMetrics->recordHandshake(m_connectTimings.total);
+                        }
+                    }
+                    m_connected = true;
+                    m_reconnectAttempt = 0;
+                    //the server's heartbeat timeout starts with the session
+                    m_lastHeartBeatSent.start();
+                    if (m_heartBeatTimeout > 0)
+                    {
+                        m_pHeartBeatTimer->start(m_heartBeatTimeout);
+                    }
+                    if (m_connectionTimeout > 0)
+                    {
+                        m_pLivenessTimer->start(m_connectionTimeout);
+                    }
+                    //join the namespaces that were requested before the socket
+                    //was connected, or that were joined on a lost connection
+                    for (QHash<QString, QSocketIoNamespace *>::const_iterator it = m_namespaces.constBegin();
+                         it != m_namespaces.constEnd(); ++it)
+                    {
+                        sendFrame(m_pFrameWriter->writeConnect(it.key()));
+                    }
+                    for (QList<HeldFrame>::const_iterator it = m_reconnectBuffer.constBegin();
+                         it != m_reconnectBuffer.constEnd(); ++it)
+                    {
+                        sendFrame(it->frame, it->attachments);
+                    }
+                    m_reconnectBuffer.clear();
+                    replayJournal();
+                }
+                if (target != this)
+                {
+                    Q_EMIT(target->connected(endpointName));
+                }
+                Q_EMIT(connected(endpointName));
                 break;
             }
-            case 2:	//heartbeat
+            case QSocketIoFrameParser::HeartbeatPacket:
             {
+                //answer right away, as the JavaScript client does
+                writeHeartBeat();
                 Q_EMIT(heartbeatReceived());
                 break;
             }
-            case 3:	//message
+            case QSocketIoFrameParser::MessagePacket:
             {
-                Q_EMIT(messageReceived(data));
+                Q_EMIT(target->messageReceived(QString::fromUtf8(data)));
                 break;
             }
-            case 4:	//json message
+            case QSocketIoFrameParser::JsonMessagePacket:
             {
                 qDebug() << "JSON message received:" << data;
                 break;
             }
-            case 5: //event
+            case QSocketIoFrameParser::EventPacket:
             {
                 QJsonParseError parseError;
-                QJsonDocument document = QJsonDocument::fromJson(QByteArray(data.toLatin1()),
-                                                                 &parseError);
+                QJsonDocument document;
+                {
+                    QSOCKETIO_TRACE_SPAN("parseJson");
+                    document = QJsonDocument::fromJson(data, &parseError);
+                }
                 if (parseError.error != QJsonParseError::NoError)
                 {
                     qDebug() << parseError.errorString();
+                    if (m_pMetrics)
+                    {
+                        m_pMetrics->recordParseError();
+                    }
                 }
                 else
                 {
                     if (document.isObject())
                     {
                         QJsonObject object = document.object();
-                        QJsonValue value = object["name"];
+                        QJsonValue value = object.value(QStringLiteral("name"));
                         if (!value.isUndefined())
                         {
                             QString message = value.toString();
                             QJsonArray arguments;
-                            QJsonValue argsValue = object["args"];
+                            QJsonValue argsValue = object.value(QStringLiteral("args"));
                             if (!argsValue.isUndefined() && !argsValue.isNull())
                             {
                                 if (argsValue.isArray())
@@ -252,35 +867,85 @@ void QSocketIoClient::parseMessage(const QString &message)
                                 else
                                 {
                                     qWarning() << "Args argument is not an array";
+                                    if (m_pMetrics)
+                                    {
+                                        m_pMetrics->recordParseError();
+                                    }
                                     return;
                                 }
                             }
-                            eventReceived(message, arguments, mustAck && !autoAck, messageId);
+                            if (m_pMetrics)
+                            {
+                                m_pMetrics->recordEventReceived(message, data.size());
+                            }
+                            const int attachments = object.value(QStringLiteral("attachments")).toInt();
+                            if (attachments > MaximumAttachments
+                                    || attachments > qSocketIoPlaceholderCount(arguments, attachments))
+                            {
+                                //more than the arguments can refer to
+                                qWarning() << "Invalid event received:" << attachments
+                                           << "attachments";
+                                if (m_pMetrics)
+                                {
+                                    m_pMetrics->recordParseError();
+                                }
+                                break;
+                            }
+                            if (attachments > 0)
+                            {
+                                //delivered once the last attachment is in
+                                m_binaryEvent.target = target;
+                                m_binaryEvent.message = message;
+                                m_binaryEvent.arguments = arguments;
+                                m_binaryEvent.mustAck = mustAck && !autoAck;
+                                m_binaryEvent.messageId = messageId;
+                                m_binaryEvent.expected = attachments;
+                                m_binaryEvent.attachments.reserve(attachments);
+                                break;
+                            }
+                            target->eventReceived(message, arguments, mustAck && !autoAck,
+                                                  messageId, QVector<QByteArray>());
                         }
                         else
                         {
                             qWarning() << "Invalid event received: no name";
+                            if (m_pMetrics)
+                            {
+                                m_pMetrics->recordParseError();
+                            }
                         }
                     }
                 }
                 break;
             }
-            case 6:	//ack
+            case QSocketIoFrameParser::AckPacket:
             {
-                QRegExp regExp("^([0-9]+)(\\+)?(.*)$", Qt::CaseInsensitive, QRegExp::RegExp2);
-                if (regExp.indexIn(data) != -1)
+                int messageId = 0;
+                QByteArray argumentsValue;
+                if (QSocketIoFrameParser::parseAck(data, &messageId, &argumentsValue))
                 {
+                    if (m_pJournal)
+                    {
+                        QHash<int, qint64>::iterator it = m_journalSequences.find(messageId);
+                        if (it != m_journalSequences.end())
+                        {
+                            m_pJournal->acknowledge(it.value());
+                            m_journalSequences.erase(it);
+                            break;
+                        }
+                    }
                     QJsonParseError parseError;
                     QJsonArray arguments;
-                    int messageId = regExp.cap(1).toInt();
-                    QString argumentsValue = regExp.cap(3);
                     if (!argumentsValue.isEmpty())
                     {
-                        QJsonDocument doc = QJsonDocument::fromJson(argumentsValue.toLatin1(),
-                                                                    &parseError);
+                        QJsonDocument doc = QJsonDocument::fromJson(argumentsValue, &parseError);
                         if (parseError.error != QJsonParseError::NoError)
                         {
                             qWarning() << "JSONParseError:" << parseError.errorString();
+                            if (m_pMetrics)
+                            {
+                                m_pMetrics->recordParseError();
+                            }
                             return;
                         }
                         else
@@ -292,118 +957,1146 @@ void QSocketIoClient::parseMessage(const QString &message)
                             else
                             {
                                 qWarning() << "Error: data of event is not an array";
+                                if (m_pMetrics)
+                                {
+                                    m_pMetrics->recordParseError();
+                                }
                                 return;
                             }
                         }
                     }
-                    ackReceived(messageId, arguments);
+                    target->ackReceived(messageId, arguments);
                 }
                 break;
             }
-            case 7:	//error
+            case QSocketIoFrameParser::ErrorPacket:
             {
-                QStringList pieces = data.split("+");
-                QString reason = pieces[0];
+                const int plus = data.indexOf('+');
+                QString reason = QString::fromUtf8(data.constData(),
+                                                   plus == -1 ? data.size() : plus);
                 QString advice;
-                if (pieces.length() == 2)
+                if (plus != -1)
                 {
-                    advice = pieces[1];
+                    advice = QString::fromUtf8(data.constData() + plus + 1,
+                                               data.size() - plus - 1);
                 }
                 Q_EMIT(errorReceived(reason, advice));
                 break;
             }
-            case 8:	//noop
+            case QSocketIoFrameParser::NoopPacket:
             {
                 qDebug() << "Noop received" << data;
                 break;
             }
+            default:
+            {
+            }
         }
     }
 }
 
-QJsonDocument QSocketIoClient::package(const QVariant &value)
+QString QSocketIoClient::sessionId() const
 {
-    if (value.canConvert<QVariantMap>()) {
-        return QJsonDocument(QJsonObject::fromVariantMap(value.toMap()));
-    } else if (value.canConvert<QVariantList>()) {
-        return QJsonDocument(QJsonArray::fromVariantList(value.toList()));
-    } else {
-        QJsonArray ar;
-        ar.append(QJsonValue::fromVariant(value));
-        return QJsonDocument(ar);
+    return m_sessionId;
+}
+
+QSocketIoNamespace *QSocketIoClient::of(const QString &endpoint)
+{
+    if (endpoint.isEmpty()) {
+        return this;
+    }
+    QSocketIoNamespace *ns = m_namespaces.value(endpoint, Q_NULLPTR);
+    if (!ns) {
+        ns = new QSocketIoNamespace(this, endpoint, this);
+        m_namespaces.insert(endpoint, ns);
+        //otherwise the connect is sent once the socket itself is connected
+        if (m_connected) {
+            sendFrame(m_pFrameWriter->writeConnect(endpoint));
+        }
+    }
+    return ns;
+}
+
+//packets for endpoints that were never joined with of() go to the root
+//namespace, as they did before namespaces existed
+QSocketIoNamespace *QSocketIoClient::namespaceFor(const QByteArray &endpoint)
+{
+    if (endpoint.isEmpty() || m_namespaces.isEmpty()) {
+        return this;
     }
+    return m_namespaces.value(QString::fromUtf8(endpoint), this);
+}
+
+void QSocketIoClient::sendAck(const QString &endpoint, int messageId, const QJsonValue &retVal)
+{
+    sendControlFrame(m_pFrameWriter->writeAck(endpoint, messageId, retVal));
 }
 
-void QSocketIoClient::emitMessage(const QString &message, bool value)
+//message ids are per client and stay in 1..INT_MAX: socket.io servers keep
+//them as JavaScript numbers, so wider ids would not survive the round trip.
+//After INT_MAX the counter wraps to 1 instead of overflowing.
+int QSocketIoClient::nextMessageId()
 {
-    const QString m_endPoint;
-    doEmitMessage(message, package(value), m_endPoint, true);
+    if (m_lastMessageId == std::numeric_limits<int>::max()) {
+        m_lastMessageId = 0;
+    }
+    return ++m_lastMessageId;
 }
 
-void QSocketIoClient::emitMessage(const QString &message, int value)
+#ifdef QT_BUILD_INTERNAL
+void QSocketIoClient::setLastMessageId(int messageId)
 {
-    const QString m_endPoint;
-    doEmitMessage(message, package(value), m_endPoint, true);
+    m_lastMessageId = messageId;
 }
 
-void QSocketIoClient::emitMessage(const QString &message, double value)
+int QSocketIoClient::lastMessageId() const
 {
-    const QString m_endPoint;
-    doEmitMessage(message, package(value), m_endPoint, true);
+    return m_lastMessageId;
 }
+#endif
 
-void QSocketIoClient::emitMessage(const QString &message, const QString &value)
+//emits made while the socket is not connected are kept until it is, up to
+//reconnectBufferSize(); while the socket is full, overflowPolicy() decides
+QSocketIoClient::EmitResult QSocketIoClient::doEmitMessage(int messageId, const QString &message,
+                                                           const QVariant &arguments,
+                                                           const QString &endpoint,
+                                                           bool callbackExpected)
 {
-    const QString m_endPoint;
-    doEmitMessage(message, package(value), m_endPoint, true);
+    QSOCKETIO_TRACE_SPAN("doEmitMessage");
+    if (!m_connected && (m_closed || m_reconnectBuffer.size() >= m_reconnectBufferSize)) {
+        return EmitNotConnected;
+    }
+    const QByteArray &frame = m_pFrameWriter->writeEvent(messageId, callbackExpected, endpoint,
+                                                         message, arguments);
+    const QVector<QByteArray> &attachments = m_pFrameWriter->attachments();
+    if (!m_connected) {
+        HeldFrame buffered;
+        //a deep copy, so that the writer keeps its reserved buffer
+        buffered.frame = QByteArray(frame.constData(), frame.size());
+        buffered.attachments = attachments;
+        m_reconnectBuffer.append(buffered);
+        if (m_pMetrics) {
+            m_pMetrics->recordEventEmitted(message, frame.size());
+        }
+        return EmitQueued;
+    }
+    if (m_heldFrames.isEmpty() && !isSocketFull()) {
+        if (m_pMetrics) {
+            m_pMetrics->recordEventEmitted(message, frame.size());
+        }
+        sendFrame(frame, attachments);
+        updateCongestion();
+        return EmitQueued;
+    }
+    if (isSocketFull()) {
+        switch (m_overflowPolicy) {
+            case FailPolicy:
+                return EmitRefused;
+            case DropNewestPolicy:
+                return EmitDropped;
+            case DropOldestPolicy:
+                if (!m_heldFrames.isEmpty()) {
+                    dropHeldFrame();
+                }
+                break;
+            case BlockPolicy:
+                //emits from other threads have waited already; this one
+                //can't, and the held frames are bounded all the same
+                if (isHoldFull()) {
+                    return EmitRefused;
+                }
+                break;
+        }
+    }
+    if (m_pMetrics) {
+        m_pMetrics->recordEventEmitted(message, frame.size());
+    }
+    holdFrame(frame, QString(), attachments, messageId, endpoint);
+    updateCongestion();
+    return EmitQueued;
 }
 
-void QSocketIoClient::emitMessage(const QString &message, const QVariantList &arguments)
+//the emit is journaled without a message id, and gets a fresh one each
+//time it is sent; the server acknowledges it on receipt, which removes it
+//from the journal. Returns false when the full journal refused it, and
+//for emits with binary attachments: a record holds a single frame.
+bool QSocketIoClient::doEmitJournaled(const QString &message, const QVariant &arguments,
+                                      const QString &endpoint)
 {
-    const QString m_endPoint;
-    doEmitMessage(message, package(arguments), m_endPoint, true);
+    QSOCKETIO_TRACE_SPAN("doEmitMessage");
+    const QByteArray &frame = m_pFrameWriter->writeEvent(0, false, endpoint, message, arguments);
+    if (!m_pFrameWriter->attachments().isEmpty()) {
+        qWarning() << "QSocketIoClient::emitMessage: emits with attachments can't be journaled,"
+                   << message << "refused";
+        return false;
+    }
+    const qint64 sequence = m_pJournal->append(frame);
+    if (sequence < 0) {
+        return false;
+    }
+    if (m_pMetrics) {
+        m_pMetrics->recordEventEmitted(message, frame.size());
+    }
+    if (m_journalSyncInterval <= 0) {
+        syncJournal();
+    } else if (!m_pJournalSyncTimer->isActive()) {
+        //one sync for all emits of the interval
+        m_pJournalSyncTimer->start(m_journalSyncInterval);
+    }
+    //without a connection, it waits in the journal for the next one
+    if (m_connected) {
+        sendJournaled(sequence, m_pJournal->record(sequence));
+    }
+    return true;
 }
 
-void QSocketIoClient::emitMessage(const QString &message, const QVariantMap &arguments)
+//journaled emits are held rather than dropped when the socket is full; one
+//dropped by DropOldestPolicy later on is sent again after a reconnect
+void QSocketIoClient::sendJournaled(qint64 sequence, const QByteArray &record)
 {
-    const QString m_endPoint;
-    doEmitMessage(message, package(arguments), m_endPoint, true);
+    const int messageId = nextMessageId();
+    m_journalSequences.insert(messageId, sequence);
+    const QByteArray id = QByteArray::number(messageId);
+    QByteArray frame;
+    frame.reserve(record.size() + id.size());
+    frame.append(record.constData(), 2);    //"5:"
+    frame.append(id);
+    frame.append(record.constData() + 2, record.size() - 2);
+    if (m_heldFrames.isEmpty() && !isSocketFull()) {
+        sendFrame(frame);
+    } else {
+        holdFrame(frame, QString(), QVector<QByteArray>());
+    }
+    updateCongestion();
 }
 
-QString QSocketIoClient::sessionId() const
+//everything that was not acknowledged, in the order it was emitted
+void QSocketIoClient::replayJournal()
 {
-    return m_sessionId;
+    if (!m_pJournal) {
+        return;
+    }
+    for (qint64 sequence = m_pJournal->firstSequence(); sequence < m_pJournal->endSequence();
+         ++sequence) {
+        if (m_pJournal->isPending(sequence)) {
+            sendJournaled(sequence, m_pJournal->record(sequence));
+        }
+    }
+}
+
+void QSocketIoClient::syncJournal()
+{
+    m_pJournalSyncTimer->stop();
+    if (m_pJournal && !m_pJournal->sync()) {
+        qWarning() << "Cannot sync the journal:" << m_pJournal->errorString();
+    }
 }
 
-void QSocketIoClient::acknowledge(int messageId, const QJsonValue &retVal)
+//only the latest value of a volatile event matters: it is dropped when
+//there is no connection, and replaces an older value of the same event that
+//is still held or batched instead of queueing behind it
+void QSocketIoClient::doEmitVolatile(const QString &message, const QVariant &arguments,
+                                     const QString &endpoint)
 {
-    QString msg = QStringLiteral("6:::") + QString::number(messageId);
-    if (!retVal.isUndefined() && !retVal.isNull()) {
-        QJsonDocument doc;
-        if (retVal.isArray()) {
-            doc.setArray(retVal.toArray());
-        } else if (retVal.isObject()) {
-            doc.setObject(retVal.toObject());
+    if (!m_connected) {
+        return;
+    }
+    const QByteArray &frame = m_pFrameWriter->writeEvent(0, false, endpoint, message, arguments);
+    const QVector<QByteArray> &attachments = m_pFrameWriter->attachments();
+    const QString key = endpoint % QLatin1Char(':') % message;
+    if (m_pMetrics) {
+        m_pMetrics->recordEventEmitted(message, frame.size());
+    }
+
+    if (!m_heldFrames.isEmpty() || isSocketFull()) {
+        QHash<QString, qint64>::const_iterator it = m_heldVolatile.constFind(key);
+        if (it != m_heldVolatile.constEnd()) {
+            HeldFrame &held = m_heldFrames[int(it.value() - m_heldSequence)];
+            m_heldBytes += heldSize(frame, attachments) - heldSize(held.frame, held.attachments);
+            held.frame = QByteArray(frame.constData(), frame.size());
+            held.attachments = attachments;
         } else {
-            QJsonArray ar;
-            ar.append(retVal);
-            doc.setArray(ar);
+            holdFrame(frame, key, attachments);
+        }
+        updateCongestion();
+        return;
+    }
+
+    if (!attachments.isEmpty()) {
+        //the attachments can't wait in the batch; the frame goes out with them
+        sendFrame(frame, attachments);
+        updateCongestion();
+        return;
+    }
+    QHash<QString, int>::const_iterator it = m_batchVolatile.constFind(key);
+    if (it != m_batchVolatile.constEnd()) {
+        const int index = it.value();
+        const int begin = m_batchOffsets.at(index);
+        const int end = (index + 1 < m_batchOffsets.size()) ? m_batchOffsets.at(index + 1)
+                                                            : m_batchBuffer.size();
+        const int delta = frame.size() - (end - begin);
+        m_batchBuffer.replace(begin, end - begin, frame);
+        for (int i = index + 1; i < m_batchOffsets.size(); ++i) {
+            m_batchOffsets[i] += delta;
         }
-        msg.append(QStringLiteral("+") + QString::fromUtf8(doc.toJson(QJsonDocument::Compact)));
+        return;
+    }
+    const int index = m_batchOffsets.size();
+    sendFrame(frame);
+    if (m_batchOffsets.size() > index) {
+        m_batchVolatile.insert(key, index);     //still waiting in the batch
+    }
+    updateCongestion();
+}
+
+//held frames are numbered, so that a volatile frame can be found by key
+void QSocketIoClient::holdFrame(const QByteArray &frame, const QString &volatileKey,
+                                const QVector<QByteArray> &attachments, int messageId,
+                                const QString &endpoint)
+{
+    HeldFrame held;
+    //a deep copy, so that the writer keeps its reserved buffer
+    held.frame = QByteArray(frame.constData(), frame.size());
+    held.volatileKey = volatileKey;
+    held.attachments = attachments;
+    held.messageId = messageId;
+    held.endpoint = endpoint;
+    if (!volatileKey.isEmpty()) {
+        m_heldVolatile.insert(volatileKey, m_heldSequence + m_heldFrames.size());
+    }
+    m_heldBytes += heldSize(held.frame, held.attachments);
+    m_heldFrames.append(held);
+}
+
+QSocketIoClient::HeldFrame QSocketIoClient::takeHeldFrame()
+{
+    const HeldFrame held = m_heldFrames.takeFirst();
+    if (!held.volatileKey.isEmpty()) {
+        m_heldVolatile.remove(held.volatileKey);
+    }
+    m_heldBytes -= heldSize(held.frame, held.attachments);
+    ++m_heldSequence;
+    return held;
+}
+
+//DropOldestPolicy: the ack of a dropped emit fails right away instead of
+//staying pending
+void QSocketIoClient::dropHeldFrame()
+{
+    const HeldFrame held = takeHeldFrame();
+    if (held.messageId == 0) {
+        return;
+    }
+    QSocketIoNamespace *target = held.endpoint.isEmpty()
+            ? this : m_namespaces.value(held.endpoint, Q_NULLPTR);
+    if (target) {
+        target->failAck(held.messageId, QSocketIo::AckQueueFullError);
+    }
+}
+
+//emits that can't wait are held up to the high watermark, on top of what
+//the socket has not written
+bool QSocketIoClient::isHoldFull() const
+{
+    return m_heldBytes >= m_highWatermarkBytes
+            || m_heldFrames.size() >= m_highWatermarkMessages;
+}
+
+//the data lane: events and connects, in order, batched when enabled. The
+//attachments of an event follow it as binary messages, right behind it.
+void QSocketIoClient::sendFrame(const QByteArray &frame, const QVector<QByteArray> &attachments)
+{
+    if (!m_connected) {
+        return;
+    }
+    if (m_pMetrics) {
+        m_pMetrics->recordSent(frame.at(0) - '0', frame.size());
     }
-    (void)m_pWebSocket->sendTextMessage(msg);
+    if (!attachments.isEmpty()) {
+        if (!m_batchOffsets.isEmpty()) {
+            flushBatch(ExplicitFlush);
+        }
+        writeFrame(frame);
+        for (int i = 0; i < attachments.size(); ++i) {
+            //never compressed: the server takes the binary messages that
+            //follow an event with attachments as they are
+            trackWrite(m_pWebSocket->sendBinaryMessage(attachments.at(i)));
+            ++m_flushStatistics.framesSent;
+        }
+        return;
+    }
+    if (!m_batchingEnabled) {
+        writeFrame(frame);
+        return;
+    }
+
+    if (m_batchOffsets.isEmpty()) {
+        m_batchAge.start();
+        m_pFlushTimer->start(m_batchFlushInterval / 1000);
+    }
+    m_batchOffsets.append(m_batchBuffer.size());
+    m_batchBuffer.append(frame);
+    ++m_flushStatistics.packetsQueued;
+    m_flushStatistics.bytesQueued += quint64(frame.size());
+
+    if (m_batchOffsets.size() >= m_batchMaximumPackets) {
+        flushBatch(CountFlush);
+    } else if (m_batchBuffer.size() >= m_batchMaximumBytes) {
+        flushBatch(SizeFlush);
+    }
+}
+
+//the control lane: acks and heartbeats go out right away, ahead of batched
+//and held events, so that a busy client isn't timed out by the server
+void QSocketIoClient::sendControlFrame(const QByteArray &frame)
+{
+    if (!m_connected) {
+        //acks and heartbeats belong to the session that was lost
+        return;
+    }
+    if (m_pMetrics) {
+        m_pMetrics->recordSent(frame.at(0) - '0', frame.size());
+    }
+    writeFrame(frame);
+}
+
+void QSocketIoClient::writeFrame(const QByteArray &frame)
+{
+    QSOCKETIO_TRACE_SPAN("socketWrite");
+    writeMessage(frame.constData(), frame.size());
+    ++m_flushStatistics.framesSent;
+}
+
+//the one place where messages reach the socket. With compression, messages
+//of compressionThreshold() bytes or more go out as compressed binary ones.
+void QSocketIoClient::writeMessage(const char *data, int size)
+{
+    if (m_compressionEnabled && size >= m_compressionThreshold) {
+        QElapsedTimer timer;
+        timer.start();
+        const QByteArray *compressed = m_pDeflate->compress(data, size);
+        if (compressed) {
+            m_compressionStatistics.compressionTime += quint64(timer.nsecsElapsed());
+            ++m_compressionStatistics.messagesCompressed;
+            m_compressionStatistics.uncompressedBytes += quint64(size);
+            m_compressionStatistics.compressedBytes += quint64(compressed->size());
+            trackWrite(m_pWebSocket->sendBinaryMessage(*compressed));
+            return;
+        }
+        qWarning() << "Cannot compress message; sending it as it is";
+    } else if (m_compressionEnabled) {
+        ++m_compressionStatistics.messagesSentRaw;
+    }
+    //QWebSocket only sends text frames from a QString; this is the one
+    //conversion left on the way out
+    trackWrite(m_pWebSocket->sendTextMessage(QString::fromUtf8(data, size)));
+}
+
+void QSocketIoClient::flush()
+{
+    if (mustQueue()) {
+        runOnIoThread([this]() {
+            flush();
+        });
+        return;
+    }
+    flushBatch(ExplicitFlush);
+}
+
+void QSocketIoClient::onFlushTimeout()
+{
+    flushBatch(DeadlineFlush);
+}
+
+void QSocketIoClient::flushBatch(FlushReason reason)
+{
+    QSOCKETIO_TRACE_SPAN("flushBatch");
+    m_pFlushTimer->stop();
+    const int packets = m_batchOffsets.size();
+    if (packets == 0) {
+        return;
+    }
+
+    const char *data = m_batchBuffer.constData();
+    if (m_multiPacketFramingEnabled && packets > 1) {
+        m_framedBuffer.resize(0);
+        for (int i = 0; i < packets; ++i) {
+            const int begin = m_batchOffsets.at(i);
+            const int end = (i + 1 < packets) ? m_batchOffsets.at(i + 1) : m_batchBuffer.size();
+            QSocketIoFrameParser::writeFramedPacket(&m_framedBuffer, data + begin, end - begin);
+        }
+        writeMessage(m_framedBuffer.constData(), m_framedBuffer.size());
+        ++m_flushStatistics.framesSent;
+    } else {
+        //without framing every packet still needs its own WebSocket frame, but
+        //they all end up in one socket write
+        for (int i = 0; i < packets; ++i) {
+            const int begin = m_batchOffsets.at(i);
+            const int end = (i + 1 < packets) ? m_batchOffsets.at(i + 1) : m_batchBuffer.size();
+            writeMessage(data + begin, end - begin);
+        }
+        m_flushStatistics.framesSent += quint64(packets);
+    }
+    m_pWebSocket->flush();
+
+    const quint64 delay = quint64(m_batchAge.nsecsElapsed() / 1000);
+    m_flushStatistics.totalQueueDelay += delay;
+    m_flushStatistics.maximumQueueDelay = qMax(m_flushStatistics.maximumQueueDelay, delay);
+    ++m_flushStatistics.flushes;
+    switch (reason) {
+        case CountFlush:    ++m_flushStatistics.countFlushes; break;
+        case SizeFlush:     ++m_flushStatistics.sizeFlushes; break;
+        case DeadlineFlush: ++m_flushStatistics.deadlineFlushes; break;
+        case ExplicitFlush: ++m_flushStatistics.explicitFlushes; break;
+    }
+
+    m_batchBuffer.resize(0);
+    m_batchOffsets.resize(0);
+    m_batchVolatile.clear();
+}
+
+//QWebSocket buffers whatever it is given; what it was given and has not
+//written yet is counted here from bytesWritten(), which includes framing
+void QSocketIoClient::trackWrite(qint64 payloadBytes)
+{
+    if (payloadBytes <= 0) {
+        return;
+    }
+    const qint64 size = wireSize(payloadBytes);
+    m_writtenFrames.append(size);
+    m_writtenBytes += size;
+}
+
+void QSocketIoClient::onBytesWritten(qint64 bytes)
+{
+    m_writtenCredit += bytes;
+    while (!m_writtenFrames.isEmpty() && m_writtenCredit >= m_writtenFrames.first()) {
+        m_writtenCredit -= m_writtenFrames.first();
+        m_writtenBytes -= m_writtenFrames.first();
+        m_writtenFrames.removeFirst();
+    }
+    if (m_writtenFrames.isEmpty()) {
+        m_writtenCredit = 0;    //don't let estimation errors pile up
+    }
+    releaseHeldFrames();
+    updateCongestion();
+}
+
+bool QSocketIoClient::isSocketFull() const
+{
+    return m_writtenBytes >= m_highWatermarkBytes
+            || m_writtenFrames.size() >= m_highWatermarkMessages;
+}
+
+void QSocketIoClient::releaseHeldFrames()
+{
+    while (!m_heldFrames.isEmpty() && !isSocketFull() && m_connected) {
+        const HeldFrame held = takeHeldFrame();
+        sendFrame(held.frame, held.attachments);
+    }
+}
+
+//congested() when the socket is full, writable() once everything that is
+//queued, held or unwritten, is down to the low watermark again
+void QSocketIoClient::updateCongestion()
+{
+    if (!m_congested.loadAcquire()) {
+        if (isSocketFull()) {
+            setCongested(true);
+            Q_EMIT(congested());
+        }
+    } else if (outboundQueueBytes() <= m_lowWatermarkBytes
+               && outboundQueueMessages() <= m_lowWatermarkMessages) {
+        setCongested(false);
+        Q_EMIT(writable());
+    }
+}
+
+void QSocketIoClient::setCongested(bool state)
+{
+    QMutexLocker locker(&m_congestionMutex);
+    m_congested.storeRelease(state ? 1 : 0);
+    if (!state) {
+        m_writableCondition.wakeAll();
+    }
+}
+
+//what was not written belongs to the lost connection
+void QSocketIoClient::resetOutboundQueue()
+{
+    m_heldFrames.clear();
+    m_heldBytes = 0;
+    m_heldVolatile.clear();
+    m_writtenFrames.clear();
+    m_writtenBytes = 0;
+    m_writtenCredit = 0;
+    if (m_congested.loadAcquire()) {
+        setCongested(false);
+        Q_EMIT(writable());
+    }
+}
+
+//with BlockPolicy, emits from other threads wait here for the I/O thread
+//to drain the queue; the I/O thread itself can't wait on its own socket
+void QSocketIoClient::waitWhileCongested()
+{
+    if (m_overflowPolicy != BlockPolicy || !mustQueue()) {
+        return;
+    }
+    QMutexLocker locker(&m_congestionMutex);
+    while (m_congested.loadAcquire() && m_pIoThread.loadAcquire()) {
+        m_writableCondition.wait(&m_congestionMutex);
+    }
+}
+
+//packets that were queued for a lost connection can't be sent anymore
+void QSocketIoClient::discardBatch()
+{
+    m_pFlushTimer->stop();
+    m_batchBuffer.resize(0);
+    m_batchOffsets.resize(0);
+    m_batchVolatile.clear();
+}
+
+void QSocketIoClient::setBatchingEnabled(bool enabled)
+{
+    if (!enabled) {
+        flushBatch(ExplicitFlush);
+    }
+    m_batchingEnabled = enabled;
+}
+
+bool QSocketIoClient::isBatchingEnabled() const
+{
+    return m_batchingEnabled;
+}
+
+void QSocketIoClient::setBatchMaximumPackets(int packets)
+{
+    m_batchMaximumPackets = qMax(1, packets);
+}
+
+int QSocketIoClient::batchMaximumPackets() const
+{
+    return m_batchMaximumPackets;
+}
+
+void QSocketIoClient::setBatchMaximumBytes(int bytes)
+{
+    m_batchMaximumBytes = qMax(1, bytes);
+}
+
+int QSocketIoClient::batchMaximumBytes() const
+{
+    return m_batchMaximumBytes;
+}
+
+//the deadline is counted from the first packet queued in a batch; Qt
+//timers have millisecond resolution, so anything below 1000us flushes on
+//the next pass through the event loop
+void QSocketIoClient::setBatchFlushInterval(int microseconds)
+{
+    m_batchFlushInterval = qMax(0, microseconds);
+}
+
+int QSocketIoClient::batchFlushInterval() const
+{
+    return m_batchFlushInterval;
+}
+
+//socket.io 0.9 servers only decode framed payloads on some transports,
+//so this is off by default and batches are sent as consecutive frames
+void QSocketIoClient::setMultiPacketFramingEnabled(bool enabled)
+{
+    m_multiPacketFramingEnabled = enabled;
+}
+
+bool QSocketIoClient::isMultiPacketFramingEnabled() const
+{
+    return m_multiPacketFramingEnabled;
+}
+
+QSocketIoFlushStatistics QSocketIoClient::flushStatistics() const
+{
+    return m_flushStatistics;
+}
+
+void QSocketIoClient::resetFlushStatistics()
+{
+    m_flushStatistics = QSocketIoFlushStatistics();
+}
+
+QSocketIoConnectTimings QSocketIoClient::connectTimings() const
+{
+    return m_connectTimings;
+}
+
+//off by default, as socket.io servers don't expect it: the server has to
+//inflate binary messages as raw DEFLATE with the trailing 00 00 ff ff of
+//permessage-deflate removed, keeping its window from one message to the
+//next and starting over with each connection, and may compress the
+//messages it sends the same way. Enable it before connecting.
+void QSocketIoClient::setCompressionEnabled(bool enabled)
+{
+    m_compressionEnabled = enabled;
+    if (enabled && !m_pDeflate) {
+        m_pDeflate = new QSocketIoDeflate();
+        if (!m_pDeflate->isValid()) {
+            qWarning() << "Cannot initialize compression";
+            delete m_pDeflate;
+            m_pDeflate = Q_NULLPTR;
+            m_compressionEnabled = false;
+        }
+    } else if (!enabled && m_pDeflate && !m_connected) {
+        //the server may still send compressed messages on a live connection
+        delete m_pDeflate;
+        m_pDeflate = Q_NULLPTR;
+    }
+}
+
+bool QSocketIoClient::isCompressionEnabled() const
+{
+    return m_compressionEnabled;
+}
+
+//smaller messages are sent as they are: they gain little, and cost a
+//deflate call and a binary frame all the same
+void QSocketIoClient::setCompressionThreshold(int bytes)
+{
+    m_compressionThreshold = qMax(0, bytes);
+}
+
+int QSocketIoClient::compressionThreshold() const
+{
+    return m_compressionThreshold;
+}
+
+QSocketIoCompressionStatistics QSocketIoClient::compressionStatistics() const
+{
+    return m_compressionStatistics;
+}
+
+void QSocketIoClient::resetCompressionStatistics()
+{
+    m_compressionStatistics = QSocketIoCompressionStatistics();
+}
+
+#ifndef QT_NO_SSL
+//used for the handshake and the WebSocket of wss:// and https:// urls; the
+//client keeps it up to date with the session of the last handshake, so
+//that reconnects can resume that session
+void QSocketIoClient::setSslConfiguration(const QSslConfiguration &configuration)
+{
+    m_sslConfiguration = configuration;
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+}
+
+QSslConfiguration QSocketIoClient::sslConfiguration() const
+{
+    return m_sslConfiguration;
+}
+#endif
+
+//reconnecting starts after reconnectionDelay() milliseconds and doubles the
+//delay with every attempt, up to reconnectionDelayMaximum()
+void QSocketIoClient::setReconnectionEnabled(bool enabled)
+{
+    m_reconnectionEnabled = enabled;
+    if (!enabled && m_pReconnectTimer->isActive()) {
+        m_pReconnectTimer->stop();
+        connectionLost(false);
+    }
+}
+
+bool QSocketIoClient::isReconnectionEnabled() const
+{
+    return m_reconnectionEnabled;
+}
+
+//-1 keeps trying forever
+void QSocketIoClient::setReconnectionAttempts(int attempts)
+{
+    m_reconnectionAttempts = qMax(-1, attempts);
+}
+
+int QSocketIoClient::reconnectionAttempts() const
+{
+    return m_reconnectionAttempts;
+}
+
+void QSocketIoClient::setReconnectionDelay(int msecs)
+{
+    m_reconnectionDelay = qMax(0, msecs);
+}
+
+int QSocketIoClient::reconnectionDelay() const
+{
+    return m_reconnectionDelay;
+}
+
+void QSocketIoClient::setReconnectionDelayMaximum(int msecs)
+{
+    m_reconnectionDelayMaximum = qMax(0, msecs);
+}
+
+int QSocketIoClient::reconnectionDelayMaximum() const
+{
+    return m_reconnectionDelayMaximum;
+}
+
+//every delay is spread uniformly over delay * (1 +- factor)
+void QSocketIoClient::setRandomizationFactor(double factor)
+{
+    m_randomizationFactor = qBound(0.0, factor, 1.0);
+}
+
+double QSocketIoClient::randomizationFactor() const
+{
+    return m_randomizationFactor;
+}
+
+//the number of emits kept while the socket is not connected; 0 drops them
+void QSocketIoClient::setReconnectBufferSize(int packets)
+{
+    m_reconnectBufferSize = qMax(0, packets);
+    while (m_reconnectBuffer.size() > m_reconnectBufferSize) {
+        m_reconnectBuffer.removeLast();
+    }
+}
+
+int QSocketIoClient::reconnectBufferSize() const
+{
+    return m_reconnectBufferSize;
+}
+
+//keeps emits without a callback in a journal in directory until the server
+//has acknowledged them. They survive lost connections and restarts of the
+//application, and are sent again, in order, once the client is connected:
+//at least once, so the server may see an emit twice. A crash can lose the
+//emits of the last journalSyncInterval() milliseconds. While a journal is
+//open, emits with QByteArray arguments are refused: their attachments
+//can't be journaled with the event.
+bool QSocketIoClient::openJournal(const QString &directory)
+{
+    closeJournal();
+    QSocketIoJournal *journal = new QSocketIoJournal(directory);
+    journal->setMaximumSize(m_journalMaximumSize);
+    journal->setDropOldest(m_journalEvictionPolicy == EvictOldestPolicy);
+    if (!journal->open()) {
+        qWarning() << "Cannot open the journal in" << directory << ":" << journal->errorString();
+        delete journal;
+        return false;
+    }
+    m_pJournal = journal;
+    if (m_connected) {
+        replayJournal();
+    }
+    return true;
+}
+
+//records that were not acknowledged stay on disk for the next openJournal()
+void QSocketIoClient::closeJournal()
+{
+    m_pJournalSyncTimer->stop();
+    m_journalSequences.clear();
+    delete m_pJournal;
+    m_pJournal = Q_NULLPTR;
+}
+
+bool QSocketIoClient::isJournalOpen() const
+{
+    return m_pJournal != Q_NULLPTR;
+}
+
+//bounds the emits in the journal that were not acknowledged, in bytes; 0
+//means unbounded. The segment files on disk can take up to 4 MB more.
+void QSocketIoClient::setJournalMaximumSize(qint64 bytes)
+{
+    m_journalMaximumSize = bytes;
+    if (m_pJournal) {
+        m_pJournal->setMaximumSize(bytes);
+    }
+}
+
+qint64 QSocketIoClient::journalMaximumSize() const
+{
+    return m_journalMaximumSize;
+}
+
+void QSocketIoClient::setJournalEvictionPolicy(JournalEvictionPolicy policy)
+{
+    m_journalEvictionPolicy = policy;
+    if (m_pJournal) {
+        m_pJournal->setDropOldest(policy == EvictOldestPolicy);
+    }
+}
+
+QSocketIoClient::JournalEvictionPolicy QSocketIoClient::journalEvictionPolicy() const
+{
+    return m_journalEvictionPolicy;
+}
+
+//journaled emits are synced to disk together, at most this many
+//milliseconds after the first of them; 0 syncs every emit on its own
+void QSocketIoClient::setJournalSyncInterval(int msecs)
+{
+    m_journalSyncInterval = qMax(0, msecs);
+}
+
+int QSocketIoClient::journalSyncInterval() const
+{
+    return m_journalSyncInterval;
+}
+
+int QSocketIoClient::journalPendingEmits() const
+{
+    return m_pJournal ? m_pJournal->pendingRecords() : 0;
+}
+
+//emits are held back once the socket has this much unwritten, and
+//overflowPolicy() decides what happens to them
+void QSocketIoClient::setOutboundHighWatermark(qint64 bytes, int messages)
+{
+    m_highWatermarkBytes = qMax(qint64(1), bytes);
+    m_highWatermarkMessages = qMax(1, messages);
+}
+
+qint64 QSocketIoClient::outboundHighWatermarkBytes() const
+{
+    return m_highWatermarkBytes;
+}
+
+int QSocketIoClient::outboundHighWatermarkMessages() const
+{
+    return m_highWatermarkMessages;
+}
+
+void QSocketIoClient::setOutboundLowWatermark(qint64 bytes, int messages)
+{
+    m_lowWatermarkBytes = qMax(qint64(0), bytes);
+    m_lowWatermarkMessages = qMax(0, messages);
+}
+
+qint64 QSocketIoClient::outboundLowWatermarkBytes() const
+{
+    return m_lowWatermarkBytes;
+}
+
+int QSocketIoClient::outboundLowWatermarkMessages() const
+{
+    return m_lowWatermarkMessages;
+}
+
+//acks, heartbeats and connects are never held or dropped. Acked emits that
+//are refused or dropped fail with QSocketIo::AckQueueFullError; other emits
+//are lost without notice.
+void QSocketIoClient::setOverflowPolicy(OverflowPolicy policy)
+{
+    m_overflowPolicy = policy;
+}
+
+QSocketIoClient::OverflowPolicy QSocketIoClient::overflowPolicy() const
+{
+    return m_overflowPolicy;
+}
+
+//held emits plus what the socket has not written yet
+qint64 QSocketIoClient::outboundQueueBytes() const
+{
+    return m_heldBytes + m_writtenBytes;
+}
+
+int QSocketIoClient::outboundQueueMessages() const
+{
+    return m_heldFrames.size() + m_writtenFrames.size();
+}
+
+//safe to call from any thread
+bool QSocketIoClient::isCongested() const
+{
+    return m_congested.loadAcquire() != 0;
+}
+
+//off by default; when off, recording costs a pointer test. Counters survive
+//switching metrics off and on again.
+void QSocketIoClient::setMetricsEnabled(bool enabled)
+{
+    QSocketIoMetrics *metrics = m_pMetricsStorage.loadAcquire();
+    if (enabled && !metrics) {
+        metrics = new QSocketIoMetrics();
+        m_pMetricsStorage.storeRelease(metrics);
+    }
+    m_pMetrics = enabled ? metrics : Q_NULLPTR;
+}
+
+bool QSocketIoClient::isMetricsEnabled() const
+{
+    return m_pMetrics != Q_NULLPTR;
+}
+
+//safe to call from any thread
+QSocketIoMetricsSnapshot QSocketIoClient::metrics() const
+{
+    const QSocketIoMetrics *metrics = m_pMetricsStorage.loadAcquire();
+    return metrics ? metrics->snapshot() : QSocketIoMetricsSnapshot();
+}
+
+//moves the client and everything it owns to a thread of its own; a client
+//with a parent can't be moved. Callbacks keep coming in the current thread
+//unless setCallbackThread() said otherwise.
+bool QSocketIoClient::startIoThread()
+{
+    if (m_pIoThread.loadAcquire()) {
+        return true;
+    }
+    if (parent()) {
+        qWarning() << "QSocketIoClient::startIoThread: cannot move a client that has a parent";
+        return false;
+    }
+    if (!m_callbackThreadSet && !m_pCallbackReceiver) {
+        m_pCallbackReceiver = new QSocketIoCallbackReceiver();
+    }
+    QThread *thread = new QThread();
+    thread->setObjectName(QStringLiteral("QSocketIo"));
+    moveToIoThread(thread);
+    m_ownsIoThread = true;
+    thread->start();
+    return true;
+}
+
+//the thread may be shared with other clients; it is not started here
+void QSocketIoClient::moveToIoThread(QThread *thread)
+{
+    moveToThread(thread);
+    m_pIoThread.storeRelease(thread);
+}
+
+//brings the client back to the calling thread; emits that were queued by
+//then are still sent
+void QSocketIoClient::stopIoThread()
+{
+    QThread *thread = m_pIoThread.loadAcquire();
+    if (!thread) {
+        return;
+    }
+    if (QThread::currentThread() == thread) {
+        qWarning() << "QSocketIoClient::stopIoThread: cannot be called from the I/O thread";
+        return;
+    }
+    QThread *caller = QThread::currentThread();
+    QMetaObject::invokeMethod(this, "pullToThread", Qt::BlockingQueuedConnection,
+                              Q_ARG(QThread*, caller));
+    if (m_ownsIoThread) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+        m_ownsIoThread = false;
+    }
+    drainOutbound();
+}
+
+bool QSocketIoClient::isIoThreadRunning() const
+{
+    return m_pIoThread.loadAcquire() != Q_NULLPTR;
+}
+
+//replaces the client's own manager, before the client is opened
+void QSocketIoClient::setSharedNetworkAccessManager(QNetworkAccessManager *manager)
+{
+    if (m_ownsNetworkAccessManager) {
+        delete m_pNetworkAccessManager;
+    }
+    m_pNetworkAccessManager = manager;
+    m_ownsNetworkAccessManager = false;
+}
+
+void QSocketIoClient::pullToThread(QThread *thread)
+{
+    {
+        //emits waiting for the I/O thread wouldn't be woken up anymore
+        QMutexLocker locker(&m_congestionMutex);
+        m_pIoThread.storeRelease(Q_NULLPTR);
+        m_writableCondition.wakeAll();
+    }
+    moveToThread(thread);
+}
+
+//the thread that handlers, ack callbacks and error callbacks run in;
+//Q_NULLPTR runs them in the I/O thread, without a detour through an event
+//loop. Slots subscribed with on() follow their connection type instead.
+void QSocketIoClient::setCallbackThread(QThread *thread)
+{
+    if (m_pCallbackReceiver) {
+        m_pCallbackReceiver->deleteLater();
+        m_pCallbackReceiver = Q_NULLPTR;
+    }
+    m_callbackThreadSet = true;
+    if (thread) {
+        m_pCallbackReceiver = new QSocketIoCallbackReceiver();
+        m_pCallbackReceiver->moveToThread(thread);
+    }
+}
+
+QThread *QSocketIoClient::callbackThread() const
+{
+    return m_pCallbackReceiver ? m_pCallbackReceiver->thread() : thread();
+}
+
+bool QSocketIoClient::mustQueue() const
+{
+    QThread *ioThread = m_pIoThread.loadAcquire();
+    return ioThread && QThread::currentThread() != ioThread;
+}
+
+//producers never take a lock; only the first item after a drain pays for
+//waking the I/O thread up
+void QSocketIoClient::postOutbound(QSocketIoOutbound item)
+{
+    m_pOutbound->enqueue(std::move(item));
+    if (m_outboundWakeup.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(this, "drainOutbound", Qt::QueuedConnection);
+    }
+}
+
+void QSocketIoClient::runOnIoThread(InplaceCallback<void()> task)
+{
+    if (!mustQueue()) {
+        task();
+        return;
+    }
+    QSocketIoOutbound item;
+    item.task = std::move(task);
+    postOutbound(std::move(item));
+}
+
+void QSocketIoClient::drainOutbound()
+{
+    //items enqueued from here on post a new wakeup
+    m_outboundWakeup.fetchAndStoreOrdered(0);
+    for (;;) {
+        QSocketIoOutbound item;
+        if (!m_pOutbound->dequeue(&item)) {
+            break;
+        }
+        if (!item.task.isNull()) {
+            item.task();
+        } else if (item.target && item.acknowledged) {
+            item.target->emitWithAck(item.message, item.arguments, std::move(item.callback),
+                                     std::move(item.errorCallback), item.timeout);
+        } else if (item.target && item.isVolatile) {
+            doEmitVolatile(item.message, item.arguments, item.target->m_endpoint);
+        } else if (item.target) {
+            item.target->emitEvent(item.message, item.arguments);
+        }
+    }
+}
+
+bool QSocketIoClient::isCallbackThread() const
+{
+    return !m_pCallbackReceiver || m_pCallbackReceiver->thread() == QThread::currentThread();
 }
 
-int QSocketIoClient::doEmitMessage(const QString &message, const QJsonDocument &document,
-                                    const QString &endpoint, bool callbackExpected)
+void QSocketIoClient::postCallback(InplaceCallback<void()> task)
 {
-    static int id = 0;
-    const QString msg = QStringLiteral("5:%1%2:%3:{\"name\":\"%4\",\"args\":%5}")
-            .arg(++id)
-            .arg(callbackExpected ? QStringLiteral("+") : QStringLiteral(""))
-            .arg(endpoint)
-            .arg(message)
-            .arg(QString::fromUtf8(document.toJson(QJsonDocument::Compact)));
-    (void)m_pWebSocket->sendTextMessage(msg);
-    return id;
+    QCoreApplication::postEvent(m_pCallbackReceiver, new QSocketIoCallbackEvent(std::move(task)));
 }
@@ -4,148 +4,429 @@
 #include <QtCore/QObject>
 #include <QtCore/QUrl>
 #include <QtCore/QStringList>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+#include <QtCore/QHash>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
 #include <QtCore/QJsonArray>
 #include <QtCore/QJsonDocument>
+#include <QtNetwork/QHostInfo>
+#ifndef QT_NO_SSL
+#include <QtNetwork/QSslConfiguration>
+#endif
 #include "QtWebSockets/QWebSocket"
 #include "qsocketio_global.h"
-#include "qcallback.h"
+#include "qsocketionamespace.h"
+#include "qsocketiometrics.h"
 
 QT_BEGIN_NAMESPACE
 
 class QNetworkAccessManager;
 class QNetworkReply;
 class QTimer;
+class QThread;
+class QSocketIoFrameWriter;
+class QSocketIoCallbackReceiver;
+class QSocketIoMetrics;
+class QSocketIoJournal;
+class QSocketIoDeflate;
+struct QSocketIoOutbound;
+template <typename T> class QSocketIoMpscQueue;
 
-class Q_SOCKETIO_EXPORT QSocketIoClient : public QObject
+struct QSocketIoFlushStatistics
+{
+    QSocketIoFlushStatistics() :
+        packetsQueued(0), bytesQueued(0), flushes(0), framesSent(0),
+        countFlushes(0), sizeFlushes(0), deadlineFlushes(0), explicitFlushes(0),
+        totalQueueDelay(0), maximumQueueDelay(0)
+    {}
+
+    quint64 packetsQueued;
+    quint64 bytesQueued;
+    quint64 flushes;
+    quint64 framesSent;     //WebSocket frames handed to the socket
+    quint64 countFlushes;
+    quint64 sizeFlushes;
+    quint64 deadlineFlushes;
+    quint64 explicitFlushes;
+    quint64 totalQueueDelay;    //microseconds the oldest packet of each batch waited
+    quint64 maximumQueueDelay;  //microseconds
+};
+
+//compressed / uncompressed bytes is the compression ratio; the times are
+//the CPU cost, in nanoseconds
+struct QSocketIoCompressionStatistics
+{
+    QSocketIoCompressionStatistics() :
+        messagesCompressed(0), messagesSentRaw(0), uncompressedBytes(0), compressedBytes(0),
+        compressionTime(0), messagesDecompressed(0), bytesBeforeDecompression(0),
+        bytesAfterDecompression(0), decompressionTime(0)
+    {}
+
+    quint64 messagesCompressed;
+    quint64 messagesSentRaw;    //below the threshold
+    quint64 uncompressedBytes;
+    quint64 compressedBytes;
+    quint64 compressionTime;
+    quint64 messagesDecompressed;
+    quint64 bytesBeforeDecompression;
+    quint64 bytesAfterDecompression;
+    quint64 decompressionTime;
+};
+
+//how long each phase of the last connect took, in microseconds; phases
+//that were not reached are 0
+struct QSocketIoConnectTimings
+{
+    QSocketIoConnectTimings() :
+        lookup(0), handshake(0), upgrade(0), session(0), total(0)
+    {}
+
+    qint64 lookup;      //waiting for the host name; 0 when it was cached
+    qint64 handshake;   //the HTTP handshake request
+    qint64 upgrade;     //opening the WebSocket
+    qint64 session;     //from the open WebSocket to the connect packet
+    qint64 total;
+};
+
+//By default the client does its I/O in the thread it lives in. After
+//startIoThread() it runs in an event loop of its own: emitMessage(), open(),
+//close() and flush() can then be called from any thread, and callbacks are
+//delivered in callbackThread(). Subscribing, of() and the setters belong to
+//the I/O thread, or must be done before it is started.
+class Q_SOCKETIO_EXPORT QSocketIoClient : public QSocketIoNamespace
 {
     Q_OBJECT
 public:
+    //what an emit does while the outbound queue is above its high watermark
+    enum OverflowPolicy
+    {
+        BlockPolicy,        //wait for writable() on other threads; hold the emit on
+                            //the I/O thread, up to the high watermark, then refuse it
+        DropOldestPolicy,   //drop the oldest emit that was not written yet
+        DropNewestPolicy,   //drop the emit
+        FailPolicy          //refuse the emit
+    };
+
+    //what a full journal does with the next emit
+    enum JournalEvictionPolicy
+    {
+        EvictOldestPolicy,  //drop the oldest emits that were not acknowledged
+        RejectNewestPolicy  //drop the emit
+    };
+
     explicit QSocketIoClient(QObject *parent = Q_NULLPTR);
     virtual ~QSocketIoClient();
 
     bool open(const QUrl &url);
-    //TODO: close() function
-
-    void emitMessage(const QString &message, bool value);
-    void emitMessage(const QString &message, int value);
-    void emitMessage(const QString &message, double value);
-    void emitMessage(const QString &message, const QString &value);
-    void emitMessage(const QString &message, const QVariantList &arguments);
-    void emitMessage(const QString &message, const QVariantMap &arguments);
-
-    template <typename Callback>
-    void emitMessage(const QString &message, bool value, Callback callback);
-    template <typename Callback>
-    void emitMessage(const QString &message, int value, Callback callback);
-    template <typename Callback>
-    void emitMessage(const QString &message, double value, Callback callback);
-    template <typename Callback>
-    void emitMessage(const QString &message, const QString &value, Callback callback);
-    template <typename Callback>
-    void emitMessage(const QString &message, const QVariantList &value, Callback callback);
-    template <typename Callback>
-    void emitMessage(const QString &message, const QVariantMap &value, Callback callback);
-
-    void on(const QString &event, const QObject *receiver, const char *member, Qt::ConnectionType);
-    template <typename Callback>
-    typename std::enable_if<function_traits<Callback>::is_function, void>::type
-    on(const QString &event, Callback callback);
+    void close();
+
+    QSocketIoNamespace *of(const QString &endpoint);
 
     QString sessionId() const;
 
+    void setBatchingEnabled(bool enabled);
+    bool isBatchingEnabled() const;
+    void setBatchMaximumPackets(int packets);
+    int batchMaximumPackets() const;
+    void setBatchMaximumBytes(int bytes);
+    int batchMaximumBytes() const;
+    void setBatchFlushInterval(int microseconds);
+    int batchFlushInterval() const;
+    void setMultiPacketFramingEnabled(bool enabled);
+    bool isMultiPacketFramingEnabled() const;
+
+    QSocketIoFlushStatistics flushStatistics() const;
+    void resetFlushStatistics();
+    QSocketIoConnectTimings connectTimings() const;
+
+    void setCompressionEnabled(bool enabled);
+    bool isCompressionEnabled() const;
+    void setCompressionThreshold(int bytes);
+    int compressionThreshold() const;
+    QSocketIoCompressionStatistics compressionStatistics() const;
+    void resetCompressionStatistics();
+
+#ifndef QT_NO_SSL
+    void setSslConfiguration(const QSslConfiguration &configuration);
+    QSslConfiguration sslConfiguration() const;
+#endif
+
+    void setReconnectionEnabled(bool enabled);
+    bool isReconnectionEnabled() const;
+    void setReconnectionAttempts(int attempts);
+    int reconnectionAttempts() const;
+    void setReconnectionDelay(int msecs);
+    int reconnectionDelay() const;
+    void setReconnectionDelayMaximum(int msecs);
+    int reconnectionDelayMaximum() const;
+    void setRandomizationFactor(double factor);
+    double randomizationFactor() const;
+    void setReconnectBufferSize(int packets);
+    int reconnectBufferSize() const;
+
+    bool openJournal(const QString &directory);
+    void closeJournal();
+    bool isJournalOpen() const;
+    void setJournalMaximumSize(qint64 bytes);
+    qint64 journalMaximumSize() const;
+    void setJournalEvictionPolicy(JournalEvictionPolicy policy);
+    JournalEvictionPolicy journalEvictionPolicy() const;
+    void setJournalSyncInterval(int msecs);
+    int journalSyncInterval() const;
+    int journalPendingEmits() const;
+
+    void setOutboundHighWatermark(qint64 bytes, int messages);
+    qint64 outboundHighWatermarkBytes() const;
+    int outboundHighWatermarkMessages() const;
+    void setOutboundLowWatermark(qint64 bytes, int messages);
+    qint64 outboundLowWatermarkBytes() const;
+    int outboundLowWatermarkMessages() const;
+    void setOverflowPolicy(OverflowPolicy policy);
+    OverflowPolicy overflowPolicy() const;
+    qint64 outboundQueueBytes() const;
+    int outboundQueueMessages() const;
+    bool isCongested() const;
+
+    void setMetricsEnabled(bool enabled);
+    bool isMetricsEnabled() const;
+    QSocketIoMetricsSnapshot metrics() const;
+
+    bool startIoThread();
+    void stopIoThread();
+    bool isIoThreadRunning() const;
+    void setCallbackThread(QThread *thread);
+    QThread *callbackThread() const;
+
+#ifdef QT_BUILD_INTERNAL
+    //autotest seam, to reach the message id wrap
+    void setLastMessageId(int messageId);
+    int lastMessageId() const;
+#endif
+
+public Q_SLOTS:
+    void flush();
+
 Q_SIGNALS:
-    void messageReceived(QString message);
     void errorReceived(QString reason, QString advice);
-    void connected(QString endpoint);
-    void disconnected(QString endpoint);
     void heartbeatReceived();
+    void reconnecting(int attempt, int delay);
+    void reconnectFailed();
+    void congested();
+    void writable();
 
 private Q_SLOTS:
     void onError(QAbstractSocket::SocketError error);
+    void onDisconnected();
     void onMessage(QString textMessage);
+    void onBinaryMessage(QByteArray message);
+    void reconnect();
 
     void sendHeartBeat();
+    void onLivenessTimeout();
+
+    void onHostLookedUp(QHostInfo info);
+    void onHandshakeFinished();
+    void onWebSocketConnected();
+
+    void onFlushTimeout();
+    void syncJournal();
+    void onBytesWritten(qint64 bytes);
 
-    void replyFinished(QNetworkReply *reply);
+    void drainOutbound();
+    void pullToThread(QThread *thread);
 
 private:
+    Q_DISABLE_COPY(QSocketIoClient)
+    friend class QSocketIoNamespace;
+    friend class QSocketIoClientPool;
+
+    //what became of an emit
+    enum EmitResult
+    {
+        EmitQueued,         //sent, batched, held or kept for the next connection
+        EmitDropped,        //dropped by DropNewestPolicy
+        EmitRefused,        //refused by the overflow policy
+        EmitNotConnected    //closed, or the reconnect buffer is full
+    };
+
+    enum FlushReason
+    {
+        CountFlush,
+        SizeFlush,
+        DeadlineFlush,
+        ExplicitFlush
+    };
+
+    struct HeldFrame
+    {
+        HeldFrame() : messageId(0) {}
+
+        QByteArray frame;
+        QString volatileKey;    //empty unless newer values replace it
+        QVector<QByteArray> attachments;
+        int messageId;          //fails its pending ack when the frame is dropped
+        QString endpoint;
+    };
+
+    //an event whose attachments are still on their way
+    struct BinaryEvent
+    {
+        BinaryEvent() : target(Q_NULLPTR), mustAck(false), messageId(0), expected(0) {}
+
+        QSocketIoNamespace *target;
+        QString message;
+        QJsonArray arguments;
+        bool mustAck;
+        int messageId;
+        int expected;           //0 when no event is waiting
+        QVector<QByteArray> attachments;
+    };
+
     QWebSocket *m_pWebSocket;
     QNetworkAccessManager *m_pNetworkAccessManager;
+    bool m_ownsNetworkAccessManager;
     QUrl m_requestUrl;
     qint32 m_connectionTimeout;
     qint32 m_heartBeatTimeout;
     QTimer *m_pHeartBeatTimer;
+    QElapsedTimer m_lastHeartBeatSent;
+    QTimer *m_pLivenessTimer;
+    QElapsedTimer m_lastReceived;
     QString m_sessionId;
-    QMap<int, QAbstractCallback *> m_callbacks;
-    QMap<QString, QAbstractCallback *> m_subscriptions;
+    bool m_connected;
+    QHash<QString, QSocketIoNamespace *> m_namespaces;
+    int m_lastMessageId;
+    QSocketIoFrameWriter *m_pFrameWriter;
+    bool m_batchingEnabled;
+    bool m_multiPacketFramingEnabled;
+    int m_batchMaximumPackets;
+    int m_batchMaximumBytes;
+    int m_batchFlushInterval;
+    QTimer *m_pFlushTimer;
+    QByteArray m_batchBuffer;
+    QVector<int> m_batchOffsets;
+    QByteArray m_framedBuffer;
+    QElapsedTimer m_batchAge;
+    QSocketIoFlushStatistics m_flushStatistics;
+    bool m_compressionEnabled;
+    int m_compressionThreshold;
+    QSocketIoDeflate *m_pDeflate;       //created when compression is enabled
+    QSocketIoCompressionStatistics m_compressionStatistics;
+    BinaryEvent m_binaryEvent;
+    QNetworkReply *m_pHandshakeReply;
+    QElapsedTimer m_handshakeStarted;
+    bool m_handshakePending;            //waiting for the host lookup
+    int m_hostLookupId;                 //-1 unless a lookup is running
+    QElapsedTimer m_hostLookedUp;
+    QElapsedTimer m_phaseStarted;
+    QSocketIoConnectTimings m_connectTimings;
+#ifndef QT_NO_SSL
+    QSslConfiguration m_sslConfiguration;   //carries the TLS session along
+#endif
+    QSocketIoMetrics *m_pMetrics;       //Q_NULLPTR while metrics are off
+    QAtomicPointer<QSocketIoMetrics> m_pMetricsStorage;
+    bool m_closed;
+    bool m_reconnectionEnabled;
+    int m_reconnectionAttempts;
+    int m_reconnectionDelay;
+    int m_reconnectionDelayMaximum;
+    double m_randomizationFactor;
+    int m_reconnectAttempt;
+    QTimer *m_pReconnectTimer;
+    int m_reconnectBufferSize;
+    QList<HeldFrame> m_reconnectBuffer;
+    QSocketIoJournal *m_pJournal;       //Q_NULLPTR unless a journal is open
+    qint64 m_journalMaximumSize;
+    JournalEvictionPolicy m_journalEvictionPolicy;
+    int m_journalSyncInterval;
+    QTimer *m_pJournalSyncTimer;
+    QHash<int, qint64> m_journalSequences;  //message id to journal record
+    qint64 m_highWatermarkBytes;
+    int m_highWatermarkMessages;
+    qint64 m_lowWatermarkBytes;
+    int m_lowWatermarkMessages;
+    OverflowPolicy m_overflowPolicy;
+    QList<HeldFrame> m_heldFrames;      //emits waiting for room in the socket
+    qint64 m_heldBytes;
+    qint64 m_heldSequence;              //of the first held frame
+    QHash<QString, qint64> m_heldVolatile;
+    QHash<QString, int> m_batchVolatile;
+    QList<qint64> m_writtenFrames;      //sizes on the wire, not confirmed yet
+    qint64 m_writtenBytes;
+    qint64 m_writtenCredit;
+    QAtomicInt m_congested;
+    QMutex m_congestionMutex;
+    QWaitCondition m_writableCondition;
+    QAtomicPointer<QThread> m_pIoThread;
+    bool m_ownsIoThread;
+    QSocketIoMpscQueue<QSocketIoOutbound> *m_pOutbound;
+    QAtomicInt m_outboundWakeup;
+    QSocketIoCallbackReceiver *m_pCallbackReceiver;
+    bool m_callbackThreadSet;
 
-    void parseMessage(const QString &message);
-    QJsonDocument package(const QVariant &value);
-    int doEmitMessage(const QString &message, const QJsonDocument &document,
-                      const QString &endpoint, bool callbackExpected);
+    void setSharedNetworkAccessManager(QNetworkAccessManager *manager);
+    void moveToIoThread(QThread *thread);
+    bool mustQueue() const;
+    void postOutbound(QSocketIoOutbound item);
+    void runOnIoThread(InplaceCallback<void()> task);
+    bool isCallbackThread() const;
+    void postCallback(InplaceCallback<void()> task);
 
-    void acknowledge(int messageId, const QJsonValue &retVal = QJsonValue());
+    bool isSecure() const;
+    QUrl handshakeUrl() const;
+    QUrl webSocketUrl() const;
+    bool lookupHost();
+    void abortHostLookup();
+    void handshake();
+    void postHandshake();
+    void connectionLost(bool recoverable);
+    int nextReconnectDelay() const;
+    void abortAllPendingAcks();
+    void discardBatch();
+    void writeHeartBeat();
+    void sendFrame(const QByteArray &frame,
+                   const QVector<QByteArray> &attachments = QVector<QByteArray>());
+    void sendControlFrame(const QByteArray &frame);
+    void writeFrame(const QByteArray &frame);
+    void writeMessage(const char *data, int size);
+    void trackWrite(qint64 payloadBytes);
+    bool isSocketFull() const;
+    void releaseHeldFrames();
+    void updateCongestion();
+    void setCongested(bool state);
+    void resetOutboundQueue();
+    void waitWhileCongested();
+    void flushBatch(FlushReason reason);
+    void receivePayload(const QByteArray &payload);
+    void parseMessage(const QByteArray &message);
+    void receiveAttachment(const QByteArray &attachment);
+    int nextMessageId();
+    EmitResult doEmitMessage(int messageId, const QString &message, const QVariant &arguments,
+                             const QString &endpoint, bool callbackExpected);
+    void doEmitVolatile(const QString &message, const QVariant &arguments,
+                        const QString &endpoint);
+    bool doEmitJournaled(const QString &message, const QVariant &arguments,
+                         const QString &endpoint);
+    void sendJournaled(qint64 sequence, const QByteArray &record);
+    void replayJournal();
+    void holdFrame(const QByteArray &frame, const QString &volatileKey,
+                   const QVector<QByteArray> &attachments, int messageId = 0,
+                   const QString &endpoint = QString());
+    HeldFrame takeHeldFrame();
+    void dropHeldFrame();
+    bool isHoldFull() const;
+    void sendAck(const QString &endpoint, int messageId, const QJsonValue &retVal);
+    QSocketIoNamespace *namespaceFor(const QByteArray &endpoint);
 
+    void handshakeFinished(QNetworkReply *reply);
     void handshakeSucceeded();
-    void ackReceived(int messageId, QJsonArray arguments);
-    void eventReceived(QString message, QJsonArray arguments, bool mustAck, int messageId);
 };
 
-template <typename Callback>
-typename std::enable_if<function_traits<Callback>::is_function, void>::type
-QSocketIoClient::on(const QString &event, Callback callback)
-{
-    m_subscriptions.insert(event, new FunctionCallback<Callback>(callback));
-}
-
-template <typename Callback>
-void QSocketIoClient::emitMessage(const QString &message,
-                                  bool value, Callback callback)
-{
-    int id = doEmitMessage(message, package(value), QString(), true);
-    m_callbacks.insert(id, new FunctionCallback<Callback>(callback));
-}
-
-template <typename Callback>
-void QSocketIoClient::emitMessage(const QString &message,
-                                  int value, Callback callback)
-{
-    int id = doEmitMessage(message, package(value), QString(), true);
-    m_callbacks.insert(id, new FunctionCallback<Callback>(callback));
-}
-
-template <typename Callback>
-void QSocketIoClient::emitMessage(const QString &message,
-                                  double value, Callback callback)
-{
-    int id = doEmitMessage(message, package(value), QString(), true);
-    m_callbacks.insert(id, new FunctionCallback<Callback>(callback));
-}
-
-template <typename Callback>
-void QSocketIoClient::emitMessage(const QString &message,
-                                  const QString &value, Callback callback)
-{
-    int id = doEmitMessage(message, package(value), QString(), true);
-    m_callbacks.insert(id, new FunctionCallback<Callback>(callback));
-}
-
-template <typename Callback>
-void QSocketIoClient::emitMessage(const QString &message,
-                                  const QVariantList &value, Callback callback)
-{
-    int id = doEmitMessage(message, package(value), QString(), true);
-    m_callbacks.insert(id, new FunctionCallback<Callback>(callback));
-}
-
-template <typename Callback>
-void QSocketIoClient::emitMessage(const QString &message,
-                                  const QVariantMap &value, Callback callback)
-{
-    int id = doEmitMessage(message, package(value), QString(), true);
-    m_callbacks.insert(id, new FunctionCallback<Callback>(callback));
-}
-
 QT_END_NAMESPACE
 
 #endif // QSOCKETIOCLIENT_H
@@ -0,0 +1,235 @@
+#include "qsocketioclientpool.h"
+#include "qsocketiopoolworker_p.h"
+#include <QtCore/QThread>
+#include <QtCore/QHash>
+#include <QtNetwork/QNetworkAccessManager>
+
+namespace
+{
+void accumulate(QSocketIoFlushStatistics *total, const QSocketIoFlushStatistics &statistics)
+{
+    total->packetsQueued += statistics.packetsQueued;
+    total->bytesQueued += statistics.bytesQueued;
+    total->flushes += statistics.flushes;
+    total->framesSent += statistics.framesSent;
+    total->countFlushes += statistics.countFlushes;
+    total->sizeFlushes += statistics.sizeFlushes;
+    total->deadlineFlushes += statistics.deadlineFlushes;
+    total->explicitFlushes += statistics.explicitFlushes;
+    total->totalQueueDelay += statistics.totalQueueDelay;
+    total->maximumQueueDelay = qMax(total->maximumQueueDelay, statistics.maximumQueueDelay);
+}
+}
+
+QSocketIoPoolWorker::QSocketIoPoolWorker() :
+    QObject(),
+    m_pNetworkAccessManager(new QNetworkAccessManager(this)),
+    m_clients(),
+    m_statistics(),
+    m_collected()
+{
+}
+
+QNetworkAccessManager *QSocketIoPoolWorker::networkAccessManager() const
+{
+    return m_pNetworkAccessManager;
+}
+
+//before the worker's thread is started
+void QSocketIoPoolWorker::addClient(QSocketIoClient *client)
+{
+    m_clients.append(client);
+    connect(client, SIGNAL(connected(QString)), this, SLOT(onConnected(QString)));
+    connect(client, SIGNAL(disconnected(QString)), this, SLOT(onDisconnected(QString)));
+    connect(client, SIGNAL(reconnectFailed()), this, SLOT(onReconnectFailed()));
+}
+
+QSocketIoPoolStatistics QSocketIoPoolWorker::statistics() const
+{
+    return m_collected;
+}
+
+void QSocketIoPoolWorker::collect()
+{
+    m_collected = m_statistics;
+    m_collected.sessions = m_clients.size();
+    for (QVector<QSocketIoClient *>::const_iterator it = m_clients.constBegin();
+         it != m_clients.constEnd(); ++it) {
+        accumulate(&m_collected.flush, (*it)->flushStatistics());
+    }
+}
+
+void QSocketIoPoolWorker::shutdown()
+{
+    for (QVector<QSocketIoClient *>::const_iterator it = m_clients.constBegin();
+         it != m_clients.constEnd(); ++it) {
+        (*it)->close();
+        delete *it;
+    }
+    m_clients.clear();
+}
+
+//namespaces report through the client's signals too; only the root
+//endpoint stands for the session
+void QSocketIoPoolWorker::onConnected(QString endpoint)
+{
+    if (endpoint.isEmpty()) {
+        ++m_statistics.connectedSessions;
+        ++m_statistics.connects;
+    }
+}
+
+void QSocketIoPoolWorker::onDisconnected(QString endpoint)
+{
+    if (endpoint.isEmpty()) {
+        --m_statistics.connectedSessions;
+        ++m_statistics.disconnects;
+    }
+}
+
+void QSocketIoPoolWorker::onReconnectFailed()
+{
+    ++m_statistics.reconnectFailures;
+}
+
+QSocketIoClientPool::QSocketIoClientPool(QObject *parent) :
+    QObject(parent),
+    m_threads(),
+    m_workers(),
+    m_clients(),
+    m_nextClient(0),
+    m_pCallbackThread(Q_NULLPTR)
+{
+}
+
+QSocketIoClientPool::~QSocketIoClientPool()
+{
+    close();
+}
+
+//opens sessions clients spread over threads workers; -1 uses one thread
+//per core. Clients are assigned to threads round-robin, so client(i) runs
+//in thread i % threadCount().
+bool QSocketIoClientPool::open(const QUrl &url, int sessions, int threads)
+{
+    close();
+    if (sessions <= 0) {
+        return false;
+    }
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+    threads = qBound(1, threads, sessions);
+
+    m_threads.reserve(threads);
+    m_workers.reserve(threads);
+    for (int i = 0; i < threads; ++i) {
+        QThread *thread = new QThread();
+        thread->setObjectName(QStringLiteral("QSocketIo %1").arg(i));
+        QSocketIoPoolWorker *worker = new QSocketIoPoolWorker();
+        worker->moveToThread(thread);
+        m_threads.append(thread);
+        m_workers.append(worker);
+    }
+
+    m_clients.reserve(sessions);
+    for (int i = 0; i < sessions; ++i) {
+        QSocketIoPoolWorker *worker = m_workers.at(i % threads);
+        QSocketIoClient *client = new QSocketIoClient();
+        client->setSharedNetworkAccessManager(worker->networkAccessManager());
+        client->setCallbackThread(m_pCallbackThread);
+        Q_EMIT(clientCreated(client, i));
+        worker->addClient(client);
+        client->moveToIoThread(m_threads.at(i % threads));
+        m_clients.append(client);
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        m_threads.at(i)->start();
+    }
+    for (int i = 0; i < sessions; ++i) {
+        m_clients.at(i)->open(url);
+    }
+    return true;
+}
+
+//closes and deletes all clients, then stops the threads
+void QSocketIoClientPool::close()
+{
+    for (int i = 0; i < m_workers.size(); ++i) {
+        QMetaObject::invokeMethod(m_workers.at(i), "shutdown", Qt::BlockingQueuedConnection);
+        m_threads.at(i)->quit();
+    }
+    for (int i = 0; i < m_threads.size(); ++i) {
+        m_threads.at(i)->wait();
+        delete m_workers.at(i);
+        delete m_threads.at(i);
+    }
+    m_threads.clear();
+    m_workers.clear();
+    m_clients.clear();
+}
+
+int QSocketIoClientPool::size() const
+{
+    return m_clients.size();
+}
+
+int QSocketIoClientPool::threadCount() const
+{
+    return m_threads.size();
+}
+
+QSocketIoClient *QSocketIoClientPool::client(int index) const
+{
+    return m_clients.value(index, Q_NULLPTR);
+}
+
+//the same key always maps to the same session while the pool is open
+QSocketIoClient *QSocketIoClientPool::clientFor(const QString &key) const
+{
+    if (m_clients.isEmpty()) {
+        return Q_NULLPTR;
+    }
+    return m_clients.at(int(qHash(key) % uint(m_clients.size())));
+}
+
+//safe to call from any thread while the pool is open
+QSocketIoClient *QSocketIoClientPool::nextClient()
+{
+    if (m_clients.isEmpty()) {
+        return Q_NULLPTR;
+    }
+    const uint next = uint(m_nextClient.fetchAndAddRelaxed(1));
+    return m_clients.at(int(next % uint(m_clients.size())));
+}
+
+//applies to the clients of the next open(); Q_NULLPTR, the default, runs
+//callbacks in the worker threads
+void QSocketIoClientPool::setCallbackThread(QThread *thread)
+{
+    m_pCallbackThread = thread;
+}
+
+QThread *QSocketIoClientPool::callbackThread() const
+{
+    return m_pCallbackThread;
+}
+
+//waits for every worker to report, so it is not meant for a hot path
+QSocketIoPoolStatistics QSocketIoClientPool::statistics() const
+{
+    QSocketIoPoolStatistics total;
+    for (QVector<QSocketIoPoolWorker *>::const_iterator it = m_workers.constBegin();
+         it != m_workers.constEnd(); ++it) {
+        QMetaObject::invokeMethod(*it, "collect", Qt::BlockingQueuedConnection);
+        const QSocketIoPoolStatistics statistics = (*it)->statistics();
+        total.sessions += statistics.sessions;
+        total.connectedSessions += statistics.connectedSessions;
+        total.connects += statistics.connects;
+        total.disconnects += statistics.disconnects;
+        total.reconnectFailures += statistics.reconnectFailures;
+        accumulate(&total.flush, statistics.flush);
+    }
+    return total;
+}
@@ -0,0 +1,74 @@
+#ifndef QSOCKETIOCLIENTPOOL_H
+#define QSOCKETIOCLIENTPOOL_H
+
+#include <QtCore/QObject>
+#include <QtCore/QUrl>
+#include <QtCore/QVector>
+#include <QtCore/QAtomicInt>
+#include "qsocketio_global.h"
+#include "qsocketioclient.h"
+
+QT_BEGIN_NAMESPACE
+
+class QThread;
+class QSocketIoPoolWorker;
+
+struct QSocketIoPoolStatistics
+{
+    QSocketIoPoolStatistics() :
+        sessions(0), connectedSessions(0), connects(0), disconnects(0),
+        reconnectFailures(0), flush()
+    {}
+
+    int sessions;
+    int connectedSessions;
+    quint64 connects;
+    quint64 disconnects;
+    quint64 reconnectFailures;
+    QSocketIoFlushStatistics flush;     //summed over all clients
+};
+
+//Shards many sessions over a few threads, each with one event loop and one
+//QNetworkAccessManager for the handshakes of all its clients. The clients
+//live in the worker threads: their emits are safe from any thread and
+//their callbacks run in the worker unless setCallbackThread() says
+//otherwise. Subscribe in a slot connected to clientCreated() with
+//Qt::DirectConnection, before the client is moved to its worker.
+class Q_SOCKETIO_EXPORT QSocketIoClientPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QSocketIoClientPool(QObject *parent = Q_NULLPTR);
+    virtual ~QSocketIoClientPool();
+
+    bool open(const QUrl &url, int sessions, int threads = -1);
+    void close();
+
+    int size() const;
+    int threadCount() const;
+
+    QSocketIoClient *client(int index) const;
+    QSocketIoClient *clientFor(const QString &key) const;
+    QSocketIoClient *nextClient();
+
+    void setCallbackThread(QThread *thread);
+    QThread *callbackThread() const;
+
+    QSocketIoPoolStatistics statistics() const;
+
+Q_SIGNALS:
+    void clientCreated(QSocketIoClient *client, int index);
+
+private:
+    Q_DISABLE_COPY(QSocketIoClientPool)
+
+    QVector<QThread *> m_threads;
+    QVector<QSocketIoPoolWorker *> m_workers;
+    QVector<QSocketIoClient *> m_clients;
+    QAtomicInt m_nextClient;
+    QThread *m_pCallbackThread;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOCLIENTPOOL_H
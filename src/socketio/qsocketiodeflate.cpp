@@ -0,0 +1,119 @@
+#include "qsocketiodeflate_p.h"
+#include <zlib.h>
+#include <limits>
+
+namespace
+{
+//the end of an empty stored block, which ends every Z_SYNC_FLUSH
+const char flushTrailer[] = { '\x00', '\x00', '\xff', '\xff' };
+const int flushTrailerSize = int(sizeof(flushTrailer));
+const int chunkSize = 4096;
+}
+
+QSocketIoDeflate::QSocketIoDeflate() :
+    m_pDeflater(new z_stream()),
+    m_pInflater(new z_stream()),
+    m_valid(false),
+    m_maximumDecompressedSize(DefaultMaximumDecompressedSize),
+    m_compressed(),
+    m_input(),
+    m_decompressed()
+{
+    //negative window bits select raw streams, without zlib headers
+    m_valid = deflateInit2(m_pDeflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                           Z_DEFAULT_STRATEGY) == Z_OK;
+    m_valid = inflateInit2(m_pInflater, -MAX_WBITS) == Z_OK && m_valid;
+    m_compressed.reserve(chunkSize);
+    m_decompressed.reserve(chunkSize);
+}
+
+QSocketIoDeflate::~QSocketIoDeflate()
+{
+    deflateEnd(m_pDeflater);
+    inflateEnd(m_pInflater);
+    delete m_pDeflater;
+    delete m_pInflater;
+}
+
+bool QSocketIoDeflate::isValid() const
+{
+    return m_valid;
+}
+
+//forgets both windows; the peer has to start over at the same time
+void QSocketIoDeflate::reset()
+{
+    deflateReset(m_pDeflater);
+    inflateReset(m_pInflater);
+}
+
+void QSocketIoDeflate::setMaximumDecompressedSize(int bytes)
+{
+    //the byte past the maximum has to fit in a QByteArray as well
+    m_maximumDecompressedSize = qBound(1, bytes, std::numeric_limits<int>::max() - 1);
+}
+
+int QSocketIoDeflate::maximumDecompressedSize() const
+{
+    return m_maximumDecompressedSize;
+}
+
+//returns Q_NULLPTR on failure
+const QByteArray *QSocketIoDeflate::compress(const char *data, int size)
+{
+    m_compressed.resize(0);
+    m_pDeflater->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    m_pDeflater->avail_in = uInt(size);
+    do {
+        const int offset = m_compressed.size();
+        m_compressed.resize(offset + qMax(chunkSize, size / 2));
+        m_pDeflater->next_out = reinterpret_cast<Bytef *>(m_compressed.data() + offset);
+        m_pDeflater->avail_out = uInt(m_compressed.size() - offset);
+        const int result = deflate(m_pDeflater, Z_SYNC_FLUSH);
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            return Q_NULLPTR;
+        }
+        m_compressed.resize(m_compressed.size() - int(m_pDeflater->avail_out));
+    } while (m_pDeflater->avail_out == 0);
+    if (m_compressed.endsWith(QByteArray::fromRawData(flushTrailer, flushTrailerSize))) {
+        m_compressed.chop(flushTrailerSize);
+    }
+    return &m_compressed;
+}
+
+//returns Q_NULLPTR on corrupt input, and when the message inflates to more
+//than maximumDecompressedSize(); the stream can't go on in either case
+const QByteArray *QSocketIoDeflate::decompress(const QByteArray &data)
+{
+    m_input.resize(0);
+    m_input.append(data);
+    m_input.append(flushTrailer, flushTrailerSize);
+    m_decompressed.resize(0);
+    m_pInflater->next_in = reinterpret_cast<Bytef *>(m_input.data());
+    m_pInflater->avail_in = uInt(m_input.size());
+    do {
+        const int offset = m_decompressed.size();
+        //one byte past the maximum tells a message that is too large from
+        //one that is just large enough
+        const qint64 room = qMin(qMax(qint64(chunkSize), qint64(m_input.size()) * 2),
+                                 qint64(m_maximumDecompressedSize) + 1 - offset);
+        m_decompressed.resize(offset + int(room));
+        m_pInflater->next_out = reinterpret_cast<Bytef *>(m_decompressed.data() + offset);
+        m_pInflater->avail_out = uInt(m_decompressed.size() - offset);
+        const int result = inflate(m_pInflater, Z_SYNC_FLUSH);
+        m_decompressed.resize(m_decompressed.size() - int(m_pInflater->avail_out));
+        if (m_decompressed.size() > m_maximumDecompressedSize) {
+            return Q_NULLPTR;
+        }
+        if (result == Z_STREAM_END) {
+            //the peer ended the stream with this message; the next one
+            //starts a new one
+            inflateReset(m_pInflater);
+            break;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            return Q_NULLPTR;
+        }
+    } while (m_pInflater->avail_out == 0);
+    return &m_decompressed;
+}
@@ -0,0 +1,58 @@
+#ifndef QSOCKETIODEFLATE_P_H
+#define QSOCKETIODEFLATE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QByteArray>
+
+struct z_stream_s;
+
+QT_BEGIN_NAMESPACE
+
+//Raw DEFLATE streams in both directions, as permessage-deflate (RFC 7692)
+//uses them: every message is flushed with Z_SYNC_FLUSH and loses the
+//trailing 00 00 ff ff, and both windows carry over from one message to
+//the next, so that keys and envelopes that were sent before compress to
+//back references. The returned buffers stay valid until the next call.
+//Inflating stops at maximumDecompressedSize(), so that a small message
+//can't expand without bounds.
+class QSocketIoDeflate
+{
+public:
+    enum { DefaultMaximumDecompressedSize = 16 * 1024 * 1024 };
+
+    QSocketIoDeflate();
+    ~QSocketIoDeflate();
+
+    bool isValid() const;
+    void reset();
+    void setMaximumDecompressedSize(int bytes);
+    int maximumDecompressedSize() const;
+
+    const QByteArray *compress(const char *data, int size);
+    const QByteArray *decompress(const QByteArray &data);
+
+private:
+    Q_DISABLE_COPY(QSocketIoDeflate)
+
+    z_stream_s *m_pDeflater;
+    z_stream_s *m_pInflater;
+    bool m_valid;
+    int m_maximumDecompressedSize;
+    QByteArray m_compressed;
+    QByteArray m_input;
+    QByteArray m_decompressed;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIODEFLATE_P_H
@@ -0,0 +1,239 @@
+#include "qsocketioframeparser.h"
+#include <limits>
+
+namespace
+{
+//separator around the packet length in a framed payload: U+FFFD in UTF-8
+const char frameSeparator[] = "\xef\xbf\xbd";
+const int frameSeparatorSize = 3;
+
+inline bool isFrameSeparator(const char *p, const char *end)
+{
+    return (end - p) >= frameSeparatorSize
+            && p[0] == frameSeparator[0] && p[1] == frameSeparator[1] && p[2] == frameSeparator[2];
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+//reads an unsigned decimal number; returns false on overflow
+inline bool readNumber(const char *&p, const char *end, int *number)
+{
+    int value = 0;
+    while (p != end && isDigit(*p)) {
+        const int digit = *p - '0';
+        if (value > (std::numeric_limits<int>::max() - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        ++p;
+    }
+    *number = value;
+    return true;
+}
+}
+
+QSocketIoFrameParser::QSocketIoFrameParser() :
+    m_packetType(InvalidPacket),
+    m_messageId(0),
+    m_dataAck(false),
+    m_pEndpoint(Q_NULLPTR),
+    m_endpointSize(0),
+    m_pData(Q_NULLPTR),
+    m_dataSize(0)
+{
+}
+
+void QSocketIoFrameParser::clear()
+{
+    m_packetType = InvalidPacket;
+    m_messageId = 0;
+    m_dataAck = false;
+    m_pEndpoint = Q_NULLPTR;
+    m_endpointSize = 0;
+    m_pData = Q_NULLPTR;
+    m_dataSize = 0;
+}
+
+bool QSocketIoFrameParser::parse(const QByteArray &frame)
+{
+    clear();
+
+    const char *p = frame.constData();
+    const char *end = p + frame.size();
+
+    //packet type: a single digit followed by a colon
+    if ((end - p) < 2 || !isDigit(p[0]) || p[1] != ':') {
+        return false;
+    }
+    const int packetType = p[0] - '0';
+    if (packetType > NoopPacket) {
+        return false;
+    }
+    p += 2;
+
+    //optional message id, optionally followed by a '+'
+    int messageId = 0;
+    if (!readNumber(p, end, &messageId)) {
+        return false;
+    }
+    bool dataAck = false;
+    if (p != end && *p == '+') {
+        dataAck = true;
+        ++p;
+    }
+    if (p == end || *p != ':') {
+        return false;
+    }
+    ++p;
+
+    //endpoint runs up to the next colon; everything after that is data
+    const char *endpoint = p;
+    while (p != end && *p != ':') {
+        ++p;
+    }
+    m_pEndpoint = endpoint;
+    m_endpointSize = int(p - endpoint);
+    if (p != end) {
+        ++p;
+    }
+    m_pData = p;
+    m_dataSize = int(end - p);
+
+    m_packetType = PacketType(packetType);
+    m_messageId = messageId;
+    m_dataAck = dataAck;
+    return true;
+}
+
+QSocketIoFrameParser::PacketType QSocketIoFrameParser::packetType() const
+{
+    return m_packetType;
+}
+
+int QSocketIoFrameParser::messageId() const
+{
+    return m_messageId;
+}
+
+bool QSocketIoFrameParser::isDataAck() const
+{
+    return m_dataAck;
+}
+
+QByteArray QSocketIoFrameParser::endpoint() const
+{
+    return QByteArray::fromRawData(m_pEndpoint, m_endpointSize);
+}
+
+QByteArray QSocketIoFrameParser::data() const
+{
+    return QByteArray::fromRawData(m_pData, m_dataSize);
+}
+
+//the data of an ack packet has the form id[+arguments]
+bool QSocketIoFrameParser::parseAck(const QByteArray &data, int *messageId, QByteArray *arguments)
+{
+    const char *begin = data.constData();
+    const char *end = begin + data.size();
+    const char *p = begin;
+
+    if (p == end || !isDigit(*p)) {
+        return false;
+    }
+    if (!readNumber(p, end, messageId)) {
+        return false;
+    }
+    if (p != end && *p == '+') {
+        ++p;
+    }
+    *arguments = QByteArray::fromRawData(p, int(end - p));
+    return true;
+}
+
+//socket.io 0.9 batches packets as \ufffd<length>\ufffd<packet>...
+bool QSocketIoFrameParser::isFramedPayload(const QByteArray &payload)
+{
+    return isFrameSeparator(payload.constData(), payload.constData() + payload.size());
+}
+
+//reads the packet at *position in a framed payload and advances *position
+//past it; the packet is a raw view into the payload. Returns false at the
+//end of the payload or when it is malformed, in which case *position is
+//left at the offending frame.
+bool QSocketIoFrameParser::readFramedPacket(const QByteArray &payload, int *position,
+                                            QByteArray *packet)
+{
+    const char *begin = payload.constData();
+    const char *end = begin + payload.size();
+    const char *p = begin + *position;
+
+    if (!isFrameSeparator(p, end)) {
+        return false;
+    }
+    p += frameSeparatorSize;
+    int length = 0;
+    if (p == end || !isDigit(*p) || !readNumber(p, end, &length)) {
+        return false;
+    }
+    if (!isFrameSeparator(p, end)) {
+        return false;
+    }
+    p += frameSeparatorSize;
+
+    //the length counts UTF-16 code units, so walk the UTF-8 sequences
+    const char *packetBegin = p;
+    while (length > 0 && p != end) {
+        const uchar c = uchar(*p);
+        int sequenceLength = 1;
+        if (c >= 0xf0) {
+            sequenceLength = 4;
+            length -= 2;    //encoded as a surrogate pair
+        } else {
+            if (c >= 0xe0) {
+                sequenceLength = 3;
+            } else if (c >= 0xc0) {
+                sequenceLength = 2;
+            }
+            length -= 1;
+        }
+        if ((end - p) < sequenceLength) {
+            return false;
+        }
+        p += sequenceLength;
+    }
+    if (length != 0) {
+        return false;
+    }
+
+    *packet = QByteArray::fromRawData(packetBegin, int(p - packetBegin));
+    *position = int(p - begin);
+    return true;
+}
+
+//appends a packet to a framed payload, the counterpart of readFramedPacket()
+void QSocketIoFrameParser::writeFramedPacket(QByteArray *payload, const char *packet, int size)
+{
+    payload->append(frameSeparator, frameSeparatorSize);
+    payload->append(QByteArray::number(utf16Length(packet, size)));
+    payload->append(frameSeparator, frameSeparatorSize);
+    payload->append(packet, size);
+}
+
+//the length of UTF-8 data in UTF-16 code units, as JavaScript counts it
+int QSocketIoFrameParser::utf16Length(const char *data, int size)
+{
+    int length = 0;
+    for (const char *end = data + size; data != end; ++data) {
+        const uchar c = uchar(*data);
+        if ((c & 0xc0) != 0x80) {
+            ++length;
+        }
+        if (c >= 0xf0) {
+            ++length;   //encoded as a surrogate pair
+        }
+    }
+    return length;
+}
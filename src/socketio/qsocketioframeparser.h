@@ -0,0 +1,60 @@
+#ifndef QSOCKETIOFRAMEPARSER_H
+#define QSOCKETIOFRAMEPARSER_H
+
+#include <QtCore/QByteArray>
+#include "qsocketio_global.h"
+
+QT_BEGIN_NAMESPACE
+
+//Tokenizes a UTF-8 encoded socket.io 0.9 frame of the form
+//type:id[+]:endpoint[:data] in a single pass. The endpoint and data are
+//returned as raw views into the parsed frame (see QByteArray::fromRawData),
+//so the frame must outlive the parser results.
+class Q_SOCKETIO_EXPORT QSocketIoFrameParser
+{
+public:
+    enum PacketType
+    {
+        InvalidPacket = -1,
+        DisconnectPacket = 0,
+        ConnectPacket = 1,
+        HeartbeatPacket = 2,
+        MessagePacket = 3,
+        JsonMessagePacket = 4,
+        EventPacket = 5,
+        AckPacket = 6,
+        ErrorPacket = 7,
+        NoopPacket = 8
+    };
+
+    QSocketIoFrameParser();
+
+    bool parse(const QByteArray &frame);
+    void clear();
+
+    PacketType packetType() const;
+    int messageId() const;
+    bool isDataAck() const;
+    QByteArray endpoint() const;
+    QByteArray data() const;
+
+    static bool parseAck(const QByteArray &data, int *messageId, QByteArray *arguments);
+
+    static bool isFramedPayload(const QByteArray &payload);
+    static bool readFramedPacket(const QByteArray &payload, int *position, QByteArray *packet);
+    static void writeFramedPacket(QByteArray *payload, const char *packet, int size);
+    static int utf16Length(const char *data, int size);
+
+private:
+    PacketType m_packetType;
+    int m_messageId;
+    bool m_dataAck;
+    const char *m_pEndpoint;
+    int m_endpointSize;
+    const char *m_pData;
+    int m_dataSize;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOFRAMEPARSER_H
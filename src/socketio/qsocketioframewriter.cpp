@@ -0,0 +1,423 @@
+#include "qsocketioframewriter_p.h"
+#include "qsocketiotrace_p.h"
+#include <QtCore/QLocale>
+#include <QtCore/qnumeric.h>
+#include <QtCore/QStringList>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonDocument>
+#include <limits>
+
+namespace
+{
+const char hexDigits[] = "0123456789abcdef";
+}
+
+QSocketIoFrameWriter::QSocketIoFrameWriter() :
+    m_frame(),
+    m_attachments()
+{
+    //reserving marks the capacity as reserved, so that resize(0) in reset()
+    //keeps the allocation around for the next frame
+    m_frame.reserve(256);
+}
+
+const QByteArray &QSocketIoFrameWriter::frame() const
+{
+    return m_frame;
+}
+
+const QVector<QByteArray> &QSocketIoFrameWriter::attachments() const
+{
+    return m_attachments;
+}
+
+void QSocketIoFrameWriter::reset()
+{
+    m_frame.resize(0);
+    if (!m_attachments.isEmpty()) {
+        m_attachments.clear();
+    }
+}
+
+//5:id[+]:endpoint:{"name":"<name>","args":<arguments>[,"attachments":<count>]}
+const QByteArray &QSocketIoFrameWriter::writeEvent(int messageId, bool dataAck,
+                                                   const QString &endpoint,
+                                                   const QString &name,
+                                                   const QVariant &arguments)
+{
+    QSOCKETIO_TRACE_SPAN("writeEvent");
+    reset();
+    writeHeader('5', messageId, dataAck, endpoint);
+    m_frame.append("{\"name\":", 8);
+    writeString(name);
+    m_frame.append(",\"args\":", 8);
+    switch (arguments.userType()) {
+        case QMetaType::QVariantMap:
+        case QMetaType::QVariantHash:
+        case QMetaType::QVariantList:
+        case QMetaType::QStringList:
+        {
+            writeVariant(arguments);
+            break;
+        }
+        default:
+        {
+            m_frame.append('[');
+            writeVariant(arguments);
+            m_frame.append(']');
+        }
+    }
+    if (!m_attachments.isEmpty()) {
+        m_frame.append(",\"attachments\":", 15);
+        writeInteger(m_attachments.size());
+    }
+    m_frame.append('}');
+    return m_frame;
+}
+
+//6::endpoint:id[+<arguments>]
+const QByteArray &QSocketIoFrameWriter::writeAck(const QString &endpoint, int messageId,
+                                                 const QJsonValue &arguments)
+{
+    reset();
+    writeHeader('6', 0, false, endpoint);
+    writeInteger(messageId);
+    if (!arguments.isUndefined() && !arguments.isNull()) {
+        m_frame.append('+');
+        if (arguments.isArray() || arguments.isObject()) {
+            writeJsonValue(arguments);
+        } else {
+            m_frame.append('[');
+            writeJsonValue(arguments);
+            m_frame.append(']');
+        }
+    }
+    return m_frame;
+}
+
+//1::endpoint
+const QByteArray &QSocketIoFrameWriter::writeConnect(const QString &endpoint)
+{
+    reset();
+    m_frame.append("1::", 3);
+    writeUtf8(endpoint, false);
+    return m_frame;
+}
+
+void QSocketIoFrameWriter::writeHeader(char packetType, int messageId, bool dataAck,
+                                       const QString &endpoint)
+{
+    m_frame.append(packetType);
+    m_frame.append(':');
+    if (messageId > 0) {
+        writeInteger(messageId);
+    }
+    if (dataAck) {
+        m_frame.append('+');
+    }
+    m_frame.append(':');
+    writeUtf8(endpoint, false);
+    m_frame.append(':');
+}
+
+void QSocketIoFrameWriter::writeInteger(qint64 value)
+{
+    if (value < 0) {
+        m_frame.append('-');
+        //negate in unsigned arithmetic, so that the minimum value survives
+        writeUnsigned(quint64(0) - quint64(value));
+    } else {
+        writeUnsigned(quint64(value));
+    }
+}
+
+void QSocketIoFrameWriter::writeUnsigned(quint64 value)
+{
+    char buffer[24];
+    char *end = buffer + sizeof(buffer);
+    char *p = end;
+    do {
+        *--p = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    m_frame.append(p, int(end - p));
+}
+
+void QSocketIoFrameWriter::writeDouble(double value)
+{
+    //JSON has no representation for nan and infinity
+    if (!qIsFinite(value)) {
+        m_frame.append("null", 4);
+        return;
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
+    m_frame.append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+#else
+    m_frame.append(QByteArray::number(value, 'g', std::numeric_limits<double>::digits10 + 2));
+#endif
+}
+
+void QSocketIoFrameWriter::writeString(const QString &string)
+{
+    m_frame.append('"');
+    writeUtf8(string, true);
+    m_frame.append('"');
+}
+
+//encodes UTF-16 to UTF-8 directly into the frame, optionally applying
+//JSON string escaping; lone surrogates are replaced by U+FFFD
+void QSocketIoFrameWriter::writeUtf8(const QString &string, bool escape)
+{
+    const ushort *p = string.utf16();
+    const ushort *end = p + string.size();
+    for (; p != end; ++p) {
+        uint c = *p;
+        if (c < 0x80) {
+            if (!escape) {
+                m_frame.append(char(c));
+                continue;
+            }
+            switch (c) {
+                case '"':  m_frame.append("\\\"", 2); break;
+                case '\\': m_frame.append("\\\\", 2); break;
+                case '\b': m_frame.append("\\b", 2); break;
+                case '\f': m_frame.append("\\f", 2); break;
+                case '\n': m_frame.append("\\n", 2); break;
+                case '\r': m_frame.append("\\r", 2); break;
+                case '\t': m_frame.append("\\t", 2); break;
+                default:
+                {
+                    if (c < 0x20) {
+                        const char escaped[6] = { '\\', 'u', '0', '0',
+                                                  hexDigits[c >> 4], hexDigits[c & 0xf] };
+                        m_frame.append(escaped, 6);
+                    } else {
+                        m_frame.append(char(c));
+                    }
+                }
+            }
+            continue;
+        }
+        if (QChar::isHighSurrogate(c) && (p + 1) != end && QChar::isLowSurrogate(p[1])) {
+            c = QChar::surrogateToUcs4(ushort(c), p[1]);
+            ++p;
+        } else if (QChar::isSurrogate(c)) {
+            c = QChar::ReplacementCharacter;
+        }
+        char encoded[4];
+        int length;
+        if (c < 0x800) {
+            encoded[0] = char(0xc0 | (c >> 6));
+            encoded[1] = char(0x80 | (c & 0x3f));
+            length = 2;
+        } else if (c < 0x10000) {
+            encoded[0] = char(0xe0 | (c >> 12));
+            encoded[1] = char(0x80 | ((c >> 6) & 0x3f));
+            encoded[2] = char(0x80 | (c & 0x3f));
+            length = 3;
+        } else {
+            encoded[0] = char(0xf0 | (c >> 18));
+            encoded[1] = char(0x80 | ((c >> 12) & 0x3f));
+            encoded[2] = char(0x80 | ((c >> 6) & 0x3f));
+            encoded[3] = char(0x80 | (c & 0x3f));
+            length = 4;
+        }
+        m_frame.append(encoded, length);
+    }
+}
+
+void QSocketIoFrameWriter::writeVariant(const QVariant &value)
+{
+    switch (value.userType()) {
+        case QMetaType::UnknownType:
+        case QMetaType::Nullptr:
+        {
+            m_frame.append("null", 4);
+            break;
+        }
+        case QMetaType::Bool:
+        {
+            if (value.toBool()) {
+                m_frame.append("true", 4);
+            } else {
+                m_frame.append("false", 5);
+            }
+            break;
+        }
+        case QMetaType::Int:
+        case QMetaType::Short:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+        {
+            writeInteger(value.toLongLong());
+            break;
+        }
+        case QMetaType::UInt:
+        case QMetaType::UShort:
+        case QMetaType::ULong:
+        case QMetaType::ULongLong:
+        {
+            writeUnsigned(value.toULongLong());
+            break;
+        }
+        case QMetaType::Double:
+        case QMetaType::Float:
+        {
+            writeDouble(value.toDouble());
+            break;
+        }
+        case QMetaType::QString:
+        {
+            writeString(*reinterpret_cast<const QString *>(value.constData()));
+            break;
+        }
+        case QMetaType::QStringList:
+        {
+            const QStringList &list = *reinterpret_cast<const QStringList *>(value.constData());
+            m_frame.append('[');
+            for (int i = 0; i < list.size(); ++i) {
+                if (i > 0) {
+                    m_frame.append(',');
+                }
+                writeString(list.at(i));
+            }
+            m_frame.append(']');
+            break;
+        }
+        case QMetaType::QVariantList:
+        {
+            const QVariantList &list = *reinterpret_cast<const QVariantList *>(value.constData());
+            m_frame.append('[');
+            for (int i = 0; i < list.size(); ++i) {
+                if (i > 0) {
+                    m_frame.append(',');
+                }
+                writeVariant(list.at(i));
+            }
+            m_frame.append(']');
+            break;
+        }
+        case QMetaType::QVariantMap:
+        {
+            const QVariantMap &map = *reinterpret_cast<const QVariantMap *>(value.constData());
+            m_frame.append('{');
+            for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+                if (it != map.constBegin()) {
+                    m_frame.append(',');
+                }
+                writeString(it.key());
+                m_frame.append(':');
+                writeVariant(it.value());
+            }
+            m_frame.append('}');
+            break;
+        }
+        case QMetaType::QVariantHash:
+        {
+            const QVariantHash &hash = *reinterpret_cast<const QVariantHash *>(value.constData());
+            m_frame.append('{');
+            for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it) {
+                if (it != hash.constBegin()) {
+                    m_frame.append(',');
+                }
+                writeString(it.key());
+                m_frame.append(':');
+                writeVariant(it.value());
+            }
+            m_frame.append('}');
+            break;
+        }
+        case QMetaType::QByteArray:
+        {
+            m_frame.append("{\"_placeholder\":true,\"num\":", 27);
+            writeInteger(m_attachments.size());
+            m_frame.append('}');
+            m_attachments.append(*reinterpret_cast<const QByteArray *>(value.constData()));
+            break;
+        }
+        case QMetaType::QJsonValue:
+        {
+            writeJsonValue(value.value<QJsonValue>());
+            break;
+        }
+        case QMetaType::QJsonArray:
+        {
+            writeJsonValue(QJsonValue(value.value<QJsonArray>()));
+            break;
+        }
+        case QMetaType::QJsonObject:
+        {
+            writeJsonValue(QJsonValue(value.value<QJsonObject>()));
+            break;
+        }
+        default:
+        {
+            //same fallback as QJsonValue::fromVariant()
+            const QString string = value.toString();
+            if (string.isEmpty()) {
+                m_frame.append("null", 4);
+            } else {
+                writeString(string);
+            }
+        }
+    }
+}
+
+void QSocketIoFrameWriter::writeJsonValue(const QJsonValue &value)
+{
+    switch (value.type()) {
+        case QJsonValue::Bool:
+        {
+            if (value.toBool()) {
+                m_frame.append("true", 4);
+            } else {
+                m_frame.append("false", 5);
+            }
+            break;
+        }
+        case QJsonValue::Double:
+        {
+            writeDouble(value.toDouble());
+            break;
+        }
+        case QJsonValue::String:
+        {
+            writeString(value.toString());
+            break;
+        }
+        case QJsonValue::Array:
+        {
+            const QJsonArray array = value.toArray();
+            m_frame.append('[');
+            for (int i = 0; i < array.size(); ++i) {
+                if (i > 0) {
+                    m_frame.append(',');
+                }
+                writeJsonValue(array.at(i));
+            }
+            m_frame.append(']');
+            break;
+        }
+        case QJsonValue::Object:
+        {
+            const QJsonObject object = value.toObject();
+            m_frame.append('{');
+            for (QJsonObject::const_iterator it = object.constBegin();
+                 it != object.constEnd(); ++it) {
+                if (it != object.constBegin()) {
+                    m_frame.append(',');
+                }
+                writeString(it.key());
+                m_frame.append(':');
+                writeJsonValue(it.value());
+            }
+            m_frame.append('}');
+            break;
+        }
+        default:
+        {
+            m_frame.append("null", 4);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef QSOCKETIOFRAMEWRITER_P_H
+#define QSOCKETIOFRAMEWRITER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QJsonValue>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+//Serializes outgoing socket.io frames straight into one reusable UTF-8
+//buffer. Values are written as compact JSON without going through
+//QJsonDocument. QByteArray arguments are written as placeholders and
+//collected in attachments(). The returned frame and the attachments stay
+//valid until the next write.
+class QSocketIoFrameWriter
+{
+public:
+    QSocketIoFrameWriter();
+
+    const QByteArray &writeEvent(int messageId, bool dataAck, const QString &endpoint,
+                                 const QString &name, const QVariant &arguments);
+    const QByteArray &writeAck(const QString &endpoint, int messageId,
+                               const QJsonValue &arguments);
+    const QByteArray &writeConnect(const QString &endpoint);
+
+    const QByteArray &frame() const;
+    const QVector<QByteArray> &attachments() const;
+
+private:
+    Q_DISABLE_COPY(QSocketIoFrameWriter)
+
+    QByteArray m_frame;
+    QVector<QByteArray> m_attachments;
+
+    void reset();
+    void writeHeader(char packetType, int messageId, bool dataAck, const QString &endpoint);
+    void writeInteger(qint64 value);
+    void writeUnsigned(quint64 value);
+    void writeDouble(double value);
+    void writeString(const QString &string);
+    void writeUtf8(const QString &string, bool escape);
+    void writeVariant(const QVariant &value);
+    void writeJsonValue(const QJsonValue &value);
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOFRAMEWRITER_P_H
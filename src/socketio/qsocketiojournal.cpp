@@ -0,0 +1,411 @@
+#include "qsocketiojournal_p.h"
+#include <QtCore/QFile>
+#include <QtCore/QDir>
+#include <QtCore/QStringList>
+#include <QtCore/QtEndian>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <qt_windows.h>
+#include <io.h>
+#endif
+
+//Each record is a header followed by the payload:
+//  quint32 payload size, little endian; 0 marks the end of a segment
+//  quint16 qChecksum() of the payload, little endian
+//  quint8  flags
+//  quint8  reserved
+//The size is written last, so that a record is only seen once it is whole.
+
+QSocketIoJournal::QSocketIoJournal(const QString &directory) :
+    m_directory(directory),
+    m_errorString(),
+    m_open(false),
+    m_maximumSize(64 * 1024 * 1024),
+    m_dropOldest(true),
+    m_segments(),
+    m_segmentBase(0),
+    m_nextSegmentNumber(0),
+    m_locations(),
+    m_firstSequence(0),
+    m_pendingRecords(0),
+    m_pendingBytes(0)
+{
+}
+
+QSocketIoJournal::~QSocketIoJournal()
+{
+    close();
+}
+
+//creates the directory if needed and takes up the records that were not
+//acknowledged when the journal was last closed; appends go to a new segment
+bool QSocketIoJournal::open()
+{
+    if (m_open) {
+        return true;
+    }
+    QDir dir(m_directory);
+    if (!dir.mkpath(QStringLiteral("."))) {
+        m_errorString = QStringLiteral("Cannot create directory %1").arg(m_directory);
+        return false;
+    }
+    //the numbers are zero padded, so the names sort in the order of writing
+    const QStringList fileNames = dir.entryList(QStringList() << QStringLiteral("*.journal"),
+                                                QDir::Files, QDir::Name);
+    for (int i = 0; i < fileNames.size(); ++i) {
+        bool ok = false;
+        const qint64 number = fileNames.at(i).section(QLatin1Char('.'), 0, 0).toLongLong(&ok, 16);
+        if (!ok) {
+            continue;
+        }
+        if (!recover(dir.filePath(fileNames.at(i)), number)) {
+            close();
+            return false;
+        }
+        m_nextSegmentNumber = number + 1;
+    }
+    m_open = true;
+    truncate();
+    return true;
+}
+
+//syncs and unmaps the segments; pending records stay on disk
+void QSocketIoJournal::close()
+{
+    for (int i = 0; i < m_segments.size(); ++i) {
+        syncSegment(&m_segments[i]);
+        releaseSegment(&m_segments[i], false);
+    }
+    m_segments.clear();
+    m_segmentBase = 0;
+    m_locations.clear();
+    m_firstSequence = 0;
+    m_pendingRecords = 0;
+    m_pendingBytes = 0;
+    m_open = false;
+}
+
+bool QSocketIoJournal::isOpen() const
+{
+    return m_open;
+}
+
+QString QSocketIoJournal::directory() const
+{
+    return m_directory;
+}
+
+QString QSocketIoJournal::errorString() const
+{
+    return m_errorString;
+}
+
+//bounds the payload of the pending records; 0 or less means unbounded.
+//On disk the journal can take up to one segment more.
+void QSocketIoJournal::setMaximumSize(qint64 bytes)
+{
+    m_maximumSize = bytes;
+}
+
+qint64 QSocketIoJournal::maximumSize() const
+{
+    return m_maximumSize;
+}
+
+//when full, append() evicts the oldest pending records, or else refuses
+void QSocketIoJournal::setDropOldest(bool dropOldest)
+{
+    m_dropOldest = dropOldest;
+}
+
+bool QSocketIoJournal::dropOldest() const
+{
+    return m_dropOldest;
+}
+
+//returns the sequence number of the record, or -1 when it was refused
+qint64 QSocketIoJournal::append(const QByteArray &record)
+{
+    if (!m_open || record.isEmpty()) {
+        return -1;
+    }
+    const qint64 size = record.size();
+    if (m_maximumSize > 0 && m_pendingBytes + size > m_maximumSize) {
+        if (!m_dropOldest || size > m_maximumSize) {
+            return -1;
+        }
+        //truncate() keeps the first location pending
+        while (m_pendingBytes + size > m_maximumSize && !m_locations.isEmpty()) {
+            evict(m_locations.first());
+            truncate();
+        }
+    }
+    if (m_segments.isEmpty() || m_segments.last().capacity - m_segments.last().used < HeaderSize + size) {
+        if (!addSegment(HeaderSize + size)) {
+            return -1;
+        }
+    }
+
+    Segment &segment = m_segments.last();
+    uchar *header = segment.data + segment.used;
+    memcpy(header + HeaderSize, record.constData(), size_t(size));
+    qToLittleEndian<quint16>(qChecksum(record.constData(), uint(size)), header + 4);
+    header[6] = 0;
+    header[7] = 0;
+    qToLittleEndian<quint32>(quint32(size), header);
+
+    Location location;
+    location.segment = m_segmentBase + m_segments.size() - 1;
+    location.offset = segment.used;
+    location.size = int(size);
+    location.pending = true;
+    m_locations.append(location);
+    segment.used += HeaderSize + size;
+    ++segment.pending;
+    ++m_pendingRecords;
+    m_pendingBytes += size;
+    return endSequence() - 1;
+}
+
+//unknown and already acknowledged sequences are ignored
+void QSocketIoJournal::acknowledge(qint64 sequence)
+{
+    if (!isPending(sequence)) {
+        return;
+    }
+    evict(m_locations[int(sequence - m_firstSequence)]);
+    truncate();
+}
+
+bool QSocketIoJournal::sync()
+{
+    bool synced = true;
+    for (int i = 0; i < m_segments.size(); ++i) {
+        synced = syncSegment(&m_segments[i]) && synced;
+    }
+    return synced;
+}
+
+bool QSocketIoJournal::hasUnsyncedRecords() const
+{
+    for (int i = m_segments.size() - 1; i >= 0; --i) {
+        if (m_segments.at(i).synced < m_segments.at(i).used) {
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 QSocketIoJournal::firstSequence() const
+{
+    return m_firstSequence;
+}
+
+qint64 QSocketIoJournal::endSequence() const
+{
+    return m_firstSequence + m_locations.size();
+}
+
+bool QSocketIoJournal::isPending(qint64 sequence) const
+{
+    return sequence >= m_firstSequence && sequence < endSequence()
+            && m_locations.at(int(sequence - m_firstSequence)).pending;
+}
+
+//points into the mapped segment: valid until the journal is changed
+QByteArray QSocketIoJournal::record(qint64 sequence) const
+{
+    if (!isPending(sequence)) {
+        return QByteArray();
+    }
+    const Location &location = m_locations.at(int(sequence - m_firstSequence));
+    const Segment &segment = segmentAt(location);
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(segment.data + location.offset
+                                                                  + HeaderSize),
+                                   location.size);
+}
+
+int QSocketIoJournal::pendingRecords() const
+{
+    return m_pendingRecords;
+}
+
+qint64 QSocketIoJournal::pendingBytes() const
+{
+    return m_pendingBytes;
+}
+
+//reads the records of a segment up to the first one that is torn; the
+//segment is not appended to anymore, as whatever follows is unknown
+bool QSocketIoJournal::recover(const QString &fileName, qint64 number)
+{
+    Segment segment;
+    segment.file = new QFile(fileName);
+    segment.number = number;
+    if (!mapSegment(&segment, 0)) {
+        return false;
+    }
+    qint64 offset = 0;
+    while (offset + HeaderSize <= segment.capacity) {
+        const uchar *header = segment.data + offset;
+        const quint32 size = qFromLittleEndian<quint32>(header);
+        if (size == 0 || size > quint64(segment.capacity - offset - HeaderSize)) {
+            break;
+        }
+        const char *payload = reinterpret_cast<const char *>(header + HeaderSize);
+        if (qChecksum(payload, size) != qFromLittleEndian<quint16>(header + 4)) {
+            break;
+        }
+        Location location;
+        location.segment = m_segmentBase + m_segments.size();
+        location.offset = offset;
+        location.size = int(size);
+        location.pending = !(header[6] & AcknowledgedFlag);
+        m_locations.append(location);
+        if (location.pending) {
+            ++segment.pending;
+            ++m_pendingRecords;
+            m_pendingBytes += size;
+        }
+        offset += HeaderSize + size;
+    }
+    segment.used = offset;
+    segment.synced = offset;
+    segment.capacity = offset;
+    m_segments.append(segment);
+    return true;
+}
+
+bool QSocketIoJournal::addSegment(qint64 minimumCapacity)
+{
+    Segment segment;
+    segment.number = m_nextSegmentNumber;
+    segment.file = new QFile(segmentFileName(segment.number));
+    if (!mapSegment(&segment, qMax(qint64(DefaultSegmentSize), minimumCapacity))) {
+        return false;
+    }
+    ++m_nextSegmentNumber;
+    m_segments.append(segment);
+    //the previous segment may hold nothing but acknowledged records
+    truncate();
+    return true;
+}
+
+//opens and maps segment->file; a capacity of 0 maps the file as it is
+bool QSocketIoJournal::mapSegment(Segment *segment, qint64 capacity)
+{
+    QFile *file = segment->file;
+    if (!file->open(QIODevice::ReadWrite)) {
+        m_errorString = file->errorString();
+        releaseSegment(segment, false);
+        return false;
+    }
+    if (capacity > 0 && file->size() < capacity && !file->resize(capacity)) {
+        m_errorString = file->errorString();
+        releaseSegment(segment, true);
+        return false;
+    }
+    segment->capacity = file->size();
+    if (segment->capacity == 0) {
+        return true;    //empty files can't be mapped, and hold no records
+    }
+    segment->data = file->map(0, segment->capacity);
+    if (!segment->data) {
+        m_errorString = file->errorString();
+        releaseSegment(segment, capacity > 0);
+        return false;
+    }
+    return true;
+}
+
+void QSocketIoJournal::releaseSegment(Segment *segment, bool remove)
+{
+    if (!segment->file) {
+        return;
+    }
+    if (segment->data) {
+        segment->file->unmap(segment->data);
+        segment->data = Q_NULLPTR;
+    }
+    if (remove) {
+        segment->file->remove();
+    } else {
+        segment->file->close();
+    }
+    delete segment->file;
+    segment->file = Q_NULLPTR;
+}
+
+//writes the records that were appended since the last sync to disk;
+//acknowledgements are left to the system, as losing one only replays a
+//record that was delivered already
+bool QSocketIoJournal::syncSegment(Segment *segment)
+{
+    if (!segment->data || segment->synced >= segment->used) {
+        return true;
+    }
+    bool synced = true;
+#if defined(Q_OS_UNIX)
+    static const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 start = segment->synced - segment->synced % pageSize;
+    synced = ::msync(segment->data + start, size_t(segment->used - start), MS_SYNC) == 0;
+#elif defined(Q_OS_WIN)
+    synced = FlushViewOfFile(segment->data + segment->synced,
+                             SIZE_T(segment->used - segment->synced))
+            && FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(segment->file->handle())));
+#endif
+    if (!synced) {
+        m_errorString = qt_error_string();
+        return false;
+    }
+    segment->synced = segment->used;
+    return true;
+}
+
+void QSocketIoJournal::evict(Location &location)
+{
+    if (!location.pending) {
+        return;
+    }
+    Segment &segment = segmentAt(location);
+    segment.data[location.offset + 6] |= AcknowledgedFlag;
+    location.pending = false;
+    --segment.pending;
+    --m_pendingRecords;
+    m_pendingBytes -= location.size;
+}
+
+//drops the acknowledged records from the head, and the segments they
+//leave empty; the last segment stays, as it is appended to
+void QSocketIoJournal::truncate()
+{
+    while (!m_locations.isEmpty() && !m_locations.first().pending) {
+        m_locations.removeFirst();
+        ++m_firstSequence;
+    }
+    while (m_segments.size() > 1 && m_segments.first().pending == 0) {
+        releaseSegment(&m_segments.first(), true);
+        m_segments.removeFirst();
+        ++m_segmentBase;
+    }
+}
+
+QSocketIoJournal::Segment &QSocketIoJournal::segmentAt(const Location &location)
+{
+    return m_segments[location.segment - m_segmentBase];
+}
+
+const QSocketIoJournal::Segment &QSocketIoJournal::segmentAt(const Location &location) const
+{
+    return m_segments.at(location.segment - m_segmentBase);
+}
+
+QString QSocketIoJournal::segmentFileName(qint64 number) const
+{
+    return QDir(m_directory).filePath(QString::number(number, 16).rightJustified(16, QLatin1Char('0'))
+                                      + QStringLiteral(".journal"));
+}
@@ -0,0 +1,122 @@
+#ifndef QSOCKETIOJOURNAL_P_H
+#define QSOCKETIOJOURNAL_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+class QFile;
+
+//An append-only log of outgoing frames in memory-mapped segment files.
+//Records are numbered from 0 each time the journal is opened.
+//acknowledge() marks a record in place, and the journal drops acknowledged
+//records from its head, deleting segments that hold nothing else. Appends
+//only reach the page cache: sync() pushes them to disk, so that callers can
+//sync a whole group of appends at once. Records are checksummed; a torn
+//record ends its segment when the journal is opened again.
+class QSocketIoJournal
+{
+public:
+    enum { DefaultSegmentSize = 4 * 1024 * 1024 };
+
+    explicit QSocketIoJournal(const QString &directory);
+    ~QSocketIoJournal();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+    QString directory() const;
+    QString errorString() const;
+
+    void setMaximumSize(qint64 bytes);
+    qint64 maximumSize() const;
+    void setDropOldest(bool dropOldest);
+    bool dropOldest() const;
+
+    qint64 append(const QByteArray &record);
+    void acknowledge(qint64 sequence);
+    bool sync();
+    bool hasUnsyncedRecords() const;
+
+    qint64 firstSequence() const;
+    qint64 endSequence() const;
+    bool isPending(qint64 sequence) const;
+    QByteArray record(qint64 sequence) const;
+
+    int pendingRecords() const;
+    qint64 pendingBytes() const;
+
+private:
+    Q_DISABLE_COPY(QSocketIoJournal)
+
+    enum { HeaderSize = 8 };
+    enum Flag
+    {
+        AcknowledgedFlag = 0x01
+    };
+
+    struct Segment
+    {
+        Segment() : file(Q_NULLPTR), data(Q_NULLPTR), capacity(0), used(0), synced(0),
+            number(0), pending(0)
+        {}
+
+        QFile *file;
+        uchar *data;
+        qint64 capacity;
+        qint64 used;
+        qint64 synced;          //bytes known to be on disk
+        qint64 number;          //orders the segment files
+        int pending;
+    };
+
+    struct Location
+    {
+        int segment;            //m_segmentBase plus the index into m_segments
+        qint64 offset;          //of the record header
+        int size;               //of the payload
+        bool pending;
+    };
+
+    QString m_directory;
+    QString m_errorString;
+    bool m_open;
+    qint64 m_maximumSize;
+    bool m_dropOldest;
+    QList<Segment> m_segments;
+    int m_segmentBase;          //segments dropped from the front so far
+    qint64 m_nextSegmentNumber;
+    QList<Location> m_locations;
+    qint64 m_firstSequence;     //of m_locations.first()
+    int m_pendingRecords;
+    qint64 m_pendingBytes;
+
+    bool recover(const QString &fileName, qint64 number);
+    bool addSegment(qint64 minimumCapacity);
+    bool mapSegment(Segment *segment, qint64 capacity);
+    void releaseSegment(Segment *segment, bool remove);
+    bool syncSegment(Segment *segment);
+    void evict(Location &location);
+    void truncate();
+    Segment &segmentAt(const Location &location);
+    const Segment &segmentAt(const Location &location) const;
+    QString segmentFileName(qint64 number) const;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOJOURNAL_P_H
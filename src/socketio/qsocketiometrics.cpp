@@ -0,0 +1,403 @@
+#include "qsocketiometrics_p.h"
+#include <cmath>
+
+namespace
+{
+const char *const packetTypeNames[QSocketIoMetricsSnapshot::PacketTypeCount] = {
+    "disconnect", "connect", "heartbeat", "message", "json", "event", "ack", "error", "noop",
+    "unknown"
+};
+
+int packetTypeIndex(int packetType)
+{
+    return (packetType >= 0 && packetType < QSocketIoMetricsSnapshot::PacketTypeCount - 1)
+            ? packetType : QSocketIoMetricsSnapshot::PacketTypeCount - 1;
+}
+
+int highestBit(quint64 value)
+{
+    int bit = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (value >> shift) {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+//stores the larger value; only one thread writes, so this never retries
+void storeMaximum(QAtomicInteger<quint64> &maximum, quint64 value)
+{
+    quint64 current = maximum.loadAcquire();
+    while (value > current && !maximum.testAndSetRelaxed(current, value, current)) {
+    }
+}
+
+QByteArray escapeLabel(const QString &value)
+{
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\");
+    escaped.replace('"', "\\\"");
+    escaped.replace('\n', "\\n");
+    return escaped;
+}
+
+void writeHeader(QByteArray *out, const QByteArray &name, const char *type, const char *help)
+{
+    out->append("# HELP ").append(name).append(' ').append(help).append('\n');
+    out->append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+void writeSample(QByteArray *out, const QByteArray &name, const QByteArray &labels,
+                 quint64 value)
+{
+    out->append(name);
+    if (!labels.isEmpty()) {
+        out->append('{').append(labels).append('}');
+    }
+    out->append(' ').append(QByteArray::number(value)).append('\n');
+}
+
+void writePacketCounter(QByteArray *out, const QByteArray &name, const char *help,
+                        const quint64 *values)
+{
+    writeHeader(out, name, "counter", help);
+    for (int i = 0; i < QSocketIoMetricsSnapshot::PacketTypeCount; ++i) {
+        writeSample(out, name, QByteArray("type=\"") + packetTypeNames[i] + '"', values[i]);
+    }
+}
+
+//cumulative buckets at every power of two, in seconds as Prometheus wants
+void writeHistogram(QByteArray *out, const QByteArray &name, const char *help,
+                    const QSocketIoHistogram &histogram)
+{
+    writeHeader(out, name, "histogram", help);
+    quint64 cumulative = 0;
+    int bucket = 0;
+    for (int magnitude = 0; magnitude <= QSocketIoHistogram::MaximumMagnitude
+         && cumulative < histogram.count; ++magnitude) {
+        const quint64 upper = (quint64(2) << magnitude) - 1;
+        for (; bucket < histogram.buckets.size()
+             && QSocketIoHistogram::bucketUpperBound(bucket) <= upper; ++bucket) {
+            cumulative += histogram.buckets.at(bucket);
+        }
+        writeSample(out, name + "_bucket",
+                    "le=\"" + QByteArray::number(double(upper + 1) / 1e6, 'g', 6) + '"',
+                    cumulative);
+    }
+    writeSample(out, name + "_bucket", QByteArrayLiteral("le=\"+Inf\""), histogram.count);
+    out->append(name).append("_sum ")
+        .append(QByteArray::number(double(histogram.sum) / 1e6, 'g', 12)).append('\n');
+    writeSample(out, name + "_count", QByteArray(), histogram.count);
+}
+}
+
+//the bucket index is the magnitude of the value, followed by its next four
+//bits; below 32 every value has a bucket of its own
+int QSocketIoHistogram::bucketFor(quint64 value)
+{
+    if (value < 2 * SubBuckets) {
+        return int(value);
+    }
+    const quint64 limit = (quint64(2) << MaximumMagnitude) - 1;
+    value = qMin(value, limit);
+    const int magnitude = highestBit(value);
+    return (magnitude - 3) * SubBuckets + int(value >> (magnitude - 4)) - SubBuckets;
+}
+
+quint64 QSocketIoHistogram::bucketLowerBound(int bucket)
+{
+    if (bucket < 2 * SubBuckets) {
+        return quint64(bucket);
+    }
+    const int magnitude = bucket / SubBuckets + 3;
+    return quint64(bucket % SubBuckets + SubBuckets) << (magnitude - 4);
+}
+
+quint64 QSocketIoHistogram::bucketUpperBound(int bucket)
+{
+    return bucketLowerBound(bucket + 1) - 1;
+}
+
+//the upper bound of the bucket that holds the value, e.g. 0.99 for p99
+qint64 QSocketIoHistogram::percentile(double fraction) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    const quint64 rank = qMax(quint64(1), quint64(std::ceil(qBound(0.0, fraction, 1.0) * double(count))));
+    quint64 cumulative = 0;
+    for (int i = 0; i < buckets.size(); ++i) {
+        cumulative += buckets.at(i);
+        if (cumulative >= rank) {
+            return qint64(qMin(bucketUpperBound(i), maximum));
+        }
+    }
+    return qint64(maximum);
+}
+
+double QSocketIoHistogram::mean() const
+{
+    return count ? double(sum) / double(count) : 0.0;
+}
+
+QSocketIoHistogramRecorder::QSocketIoHistogramRecorder() :
+    m_count(0),
+    m_sum(0),
+    m_maximum(0)
+{
+    for (int i = 0; i < QSocketIoHistogram::BucketCount; ++i) {
+        m_buckets[i].storeRelease(0);
+    }
+}
+
+void QSocketIoHistogramRecorder::record(quint64 value)
+{
+    m_buckets[QSocketIoHistogram::bucketFor(value)].fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(value);
+    storeMaximum(m_maximum, value);
+    //last, so that a reader never counts more values than it finds in buckets
+    m_count.fetchAndAddRelease(1);
+}
+
+void QSocketIoHistogramRecorder::read(QSocketIoHistogram *histogram) const
+{
+    histogram->count = m_count.loadAcquire();
+    histogram->sum = m_sum.loadAcquire();
+    histogram->maximum = m_maximum.loadAcquire();
+    histogram->buckets.clear();
+    if (histogram->count == 0) {
+        return;
+    }
+    histogram->buckets.resize(QSocketIoHistogram::BucketCount);
+    for (int i = 0; i < QSocketIoHistogram::BucketCount; ++i) {
+        histogram->buckets[i] = m_buckets[i].loadAcquire();
+    }
+}
+
+QSocketIoMetrics::QSocketIoMetrics() :
+    m_parseErrors(0),
+    m_acksRequested(0),
+    m_acksReceived(0),
+    m_acksTimedOut(0),
+    m_acksFailed(0),
+    m_ackLatency(),
+    m_handshakeDuration(),
+    m_clock(),
+    m_pEvents(Q_NULLPTR),
+    m_eventIndex(),
+    m_pOtherEvents(Q_NULLPTR)
+{
+    for (int i = 0; i < QSocketIoMetricsSnapshot::PacketTypeCount; ++i) {
+        m_framesReceived[i].storeRelease(0);
+        m_bytesReceived[i].storeRelease(0);
+        m_framesSent[i].storeRelease(0);
+        m_bytesSent[i].storeRelease(0);
+    }
+    m_clock.start();
+}
+
+QSocketIoMetrics::~QSocketIoMetrics()
+{
+    EventCounters *counters = m_pEvents.loadAcquire();
+    while (counters) {
+        EventCounters *next = counters->next;
+        delete counters;
+        counters = next;
+    }
+}
+
+void QSocketIoMetrics::recordReceived(int packetType, int bytes)
+{
+    const int index = packetTypeIndex(packetType);
+    m_framesReceived[index].fetchAndAddRelaxed(1);
+    m_bytesReceived[index].fetchAndAddRelaxed(quint64(bytes));
+}
+
+void QSocketIoMetrics::recordSent(int packetType, int bytes)
+{
+    const int index = packetTypeIndex(packetType);
+    m_framesSent[index].fetchAndAddRelaxed(1);
+    m_bytesSent[index].fetchAndAddRelaxed(quint64(bytes));
+}
+
+void QSocketIoMetrics::recordParseError()
+{
+    m_parseErrors.fetchAndAddRelaxed(1);
+}
+
+void QSocketIoMetrics::recordEventReceived(const QString &name, int bytes)
+{
+    EventCounters *counters = countersFor(name);
+    counters->received.fetchAndAddRelaxed(1);
+    counters->receivedBytes.fetchAndAddRelaxed(quint64(bytes));
+}
+
+void QSocketIoMetrics::recordEventEmitted(const QString &name, int bytes)
+{
+    EventCounters *counters = countersFor(name);
+    counters->emitted.fetchAndAddRelaxed(1);
+    counters->emittedBytes.fetchAndAddRelaxed(quint64(bytes));
+}
+
+void QSocketIoMetrics::recordAckRequested()
+{
+    m_acksRequested.fetchAndAddRelaxed(1);
+}
+
+void QSocketIoMetrics::recordAckReceived(qint64 emittedAt)
+{
+    m_acksReceived.fetchAndAddRelaxed(1);
+    if (emittedAt > 0) {
+        m_ackLatency.record(quint64(qMax(qint64(0), now() - emittedAt)) / 1000);
+    }
+}
+
+void QSocketIoMetrics::recordAckTimedOut()
+{
+    m_acksTimedOut.fetchAndAddRelaxed(1);
+}
+
+void QSocketIoMetrics::recordAckFailed()
+{
+    m_acksFailed.fetchAndAddRelaxed(1);
+}
+
+void QSocketIoMetrics::recordHandshake(qint64 microseconds)
+{
+    m_handshakeDuration.record(quint64(qMax(qint64(0), microseconds)));
+}
+
+//never 0, which marks an emit that was made while metrics were off
+qint64 QSocketIoMetrics::now() const
+{
+    return m_clock.nsecsElapsed() + 1;
+}
+
+QSocketIoMetrics::EventCounters *QSocketIoMetrics::countersFor(const QString &name)
+{
+    QHash<QString, EventCounters *>::const_iterator it = m_eventIndex.constFind(name);
+    if (it != m_eventIndex.constEnd()) {
+        return it.value();
+    }
+    if (m_eventIndex.size() >= MaximumEvents) {
+        if (m_pOtherEvents) {
+            return m_pOtherEvents;
+        }
+    }
+    EventCounters *counters = new EventCounters();
+    if (m_eventIndex.size() < MaximumEvents) {
+        counters->name = name;
+        m_eventIndex.insert(name, counters);
+    } else {
+        m_pOtherEvents = counters;
+    }
+    counters->received.storeRelease(0);
+    counters->receivedBytes.storeRelease(0);
+    counters->emitted.storeRelease(0);
+    counters->emittedBytes.storeRelease(0);
+    counters->next = m_pEvents.loadAcquire();
+    m_pEvents.storeRelease(counters);
+    return counters;
+}
+
+QSocketIoMetricsSnapshot QSocketIoMetrics::snapshot() const
+{
+    QSocketIoMetricsSnapshot snapshot;
+    for (int i = 0; i < QSocketIoMetricsSnapshot::PacketTypeCount; ++i) {
+        snapshot.framesReceived[i] = m_framesReceived[i].loadAcquire();
+        snapshot.bytesReceived[i] = m_bytesReceived[i].loadAcquire();
+        snapshot.framesSent[i] = m_framesSent[i].loadAcquire();
+        snapshot.bytesSent[i] = m_bytesSent[i].loadAcquire();
+    }
+    snapshot.parseErrors = m_parseErrors.loadAcquire();
+    snapshot.acksReceived = m_acksReceived.loadAcquire();
+    snapshot.acksTimedOut = m_acksTimedOut.loadAcquire();
+    snapshot.acksFailed = m_acksFailed.loadAcquire();
+    //read last, so that it covers everything that was settled
+    snapshot.acksRequested = m_acksRequested.loadAcquire();
+    const quint64 settled = snapshot.acksReceived + snapshot.acksTimedOut + snapshot.acksFailed;
+    snapshot.pendingAcks = snapshot.acksRequested > settled
+            ? snapshot.acksRequested - settled : 0;
+    m_ackLatency.read(&snapshot.ackLatency);
+    m_handshakeDuration.read(&snapshot.handshakeDuration);
+    snapshot.handshakes = snapshot.handshakeDuration.count;
+
+    for (const EventCounters *counters = m_pEvents.loadAcquire(); counters;
+         counters = counters->next) {
+        QSocketIoEventMetrics event;
+        event.name = counters->name;
+        event.received = counters->received.loadAcquire();
+        event.receivedBytes = counters->receivedBytes.loadAcquire();
+        event.emitted = counters->emitted.loadAcquire();
+        event.emittedBytes = counters->emittedBytes.loadAcquire();
+        snapshot.events.append(event);
+    }
+    return snapshot;
+}
+
+QSocketIoMetricsSnapshot::QSocketIoMetricsSnapshot() :
+    parseErrors(0), acksRequested(0), acksReceived(0), acksTimedOut(0), acksFailed(0),
+    pendingAcks(0), handshakes(0), events(), ackLatency(), handshakeDuration()
+{
+    for (int i = 0; i < PacketTypeCount; ++i) {
+        framesReceived[i] = 0;
+        bytesReceived[i] = 0;
+        framesSent[i] = 0;
+        bytesSent[i] = 0;
+    }
+}
+
+const char *QSocketIoMetricsSnapshot::packetTypeName(int type)
+{
+    return packetTypeNames[packetTypeIndex(type)];
+}
+
+//the Prometheus text exposition format, version 0.0.4
+QByteArray QSocketIoMetricsSnapshot::toPrometheus(const QByteArray &prefix) const
+{
+    QByteArray out;
+    out.reserve(4096);
+    const QByteArray name = prefix + '_';
+
+    writePacketCounter(&out, name + "frames_received_total",
+                       "Packets received, by packet type.", framesReceived);
+    writePacketCounter(&out, name + "bytes_received_total",
+                       "Bytes of packets received, by packet type.", bytesReceived);
+    writePacketCounter(&out, name + "frames_sent_total",
+                       "Packets sent, by packet type.", framesSent);
+    writePacketCounter(&out, name + "bytes_sent_total",
+                       "Bytes of packets sent, by packet type.", bytesSent);
+
+    writeHeader(&out, name + "parse_errors_total", "counter", "Packets that could not be parsed.");
+    writeSample(&out, name + "parse_errors_total", QByteArray(), parseErrors);
+    writeHeader(&out, name + "acks_total", "counter", "Acknowledged emits, by outcome.");
+    writeSample(&out, name + "acks_total", QByteArrayLiteral("outcome=\"requested\""), acksRequested);
+    writeSample(&out, name + "acks_total", QByteArrayLiteral("outcome=\"received\""), acksReceived);
+    writeSample(&out, name + "acks_total", QByteArrayLiteral("outcome=\"timeout\""), acksTimedOut);
+    writeSample(&out, name + "acks_total", QByteArrayLiteral("outcome=\"failed\""), acksFailed);
+    writeHeader(&out, name + "pending_acks", "gauge", "Emits waiting for their ack.");
+    writeSample(&out, name + "pending_acks", QByteArray(), pendingAcks);
+
+    writeHeader(&out, name + "events_received_total", "counter", "Events received, by name.");
+    for (int i = 0; i < events.size(); ++i) {
+        const QByteArray label = events.at(i).name.isEmpty()
+                ? QByteArrayLiteral("event=\"\",other=\"true\"")
+                : "event=\"" + escapeLabel(events.at(i).name) + '"';
+        writeSample(&out, name + "events_received_total", label, events.at(i).received);
+    }
+    writeHeader(&out, name + "events_emitted_total", "counter", "Events emitted, by name.");
+    for (int i = 0; i < events.size(); ++i) {
+        const QByteArray label = events.at(i).name.isEmpty()
+                ? QByteArrayLiteral("event=\"\",other=\"true\"")
+                : "event=\"" + escapeLabel(events.at(i).name) + '"';
+        writeSample(&out, name + "events_emitted_total", label, events.at(i).emitted);
+    }
+
+    writeHistogram(&out, name + "ack_latency_seconds",
+                   "Time from an emit to its ack.", ackLatency);
+    writeHistogram(&out, name + "handshake_duration_seconds",
+                   "Time from the handshake request to the connect packet.", handshakeDuration);
+    return out;
+}
@@ -0,0 +1,78 @@
+#ifndef QSOCKETIOMETRICS_H
+#define QSOCKETIOMETRICS_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QByteArray>
+#include "qsocketio_global.h"
+
+QT_BEGIN_NAMESPACE
+
+//A log-linear histogram of microseconds, as in HdrHistogram: every power of
+//two is split into 16 buckets, so values are kept to within 1/16.
+struct Q_SOCKETIO_EXPORT QSocketIoHistogram
+{
+    enum
+    {
+        SubBuckets = 16,
+        MaximumMagnitude = 35,      //values up to 2^36 microseconds
+        BucketCount = (MaximumMagnitude - 2) * SubBuckets
+    };
+
+    QSocketIoHistogram() : count(0), sum(0), maximum(0), buckets() {}
+
+    quint64 count;
+    quint64 sum;
+    quint64 maximum;
+    QVector<quint64> buckets;   //BucketCount entries, empty without values
+
+    qint64 percentile(double fraction) const;
+    double mean() const;
+
+    static int bucketFor(quint64 value);
+    static quint64 bucketLowerBound(int bucket);
+    static quint64 bucketUpperBound(int bucket);
+};
+
+struct QSocketIoEventMetrics
+{
+    QSocketIoEventMetrics() :
+        name(), received(0), receivedBytes(0), emitted(0), emittedBytes(0)
+    {}
+
+    QString name;   //empty for the events beyond the tracked ones
+    quint64 received;
+    quint64 receivedBytes;
+    quint64 emitted;
+    quint64 emittedBytes;
+};
+
+struct Q_SOCKETIO_EXPORT QSocketIoMetricsSnapshot
+{
+    enum { PacketTypeCount = 10 };  //the socket.io 0.9 types, then unknown
+
+    QSocketIoMetricsSnapshot();
+
+    quint64 framesReceived[PacketTypeCount];
+    quint64 bytesReceived[PacketTypeCount];
+    quint64 framesSent[PacketTypeCount];
+    quint64 bytesSent[PacketTypeCount];
+    quint64 parseErrors;
+    quint64 acksRequested;
+    quint64 acksReceived;
+    quint64 acksTimedOut;
+    quint64 acksFailed;
+    quint64 pendingAcks;
+    quint64 handshakes;
+    QVector<QSocketIoEventMetrics> events;
+    QSocketIoHistogram ackLatency;          //emit to ack, in microseconds
+    QSocketIoHistogram handshakeDuration;   //handshake request to connect packet
+
+    QByteArray toPrometheus(const QByteArray &prefix = QByteArrayLiteral("socketio")) const;
+
+    static const char *packetTypeName(int type);
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOMETRICS_H
@@ -0,0 +1,102 @@
+#ifndef QSOCKETIOMETRICS_P_H
+#define QSOCKETIOMETRICS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include "qsocketiometrics.h"
+
+QT_BEGIN_NAMESPACE
+
+class QSocketIoHistogramRecorder
+{
+public:
+    QSocketIoHistogramRecorder();
+
+    void record(quint64 value);
+    void read(QSocketIoHistogram *histogram) const;
+
+private:
+    Q_DISABLE_COPY(QSocketIoHistogramRecorder)
+
+    QAtomicInteger<quint64> m_buckets[QSocketIoHistogram::BucketCount];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+    QAtomicInteger<quint64> m_maximum;
+};
+
+//The counters of a client. Only the I/O thread records, so the atomics
+//only have to make the values readable from other threads; nothing waits
+//on a lock on either side. Per-event counters are published on a list
+//that only grows, so readers can walk it while events are added.
+class QSocketIoMetrics
+{
+public:
+    enum { MaximumEvents = 256 };   //event names come from the server
+
+    QSocketIoMetrics();
+    ~QSocketIoMetrics();
+
+    void recordReceived(int packetType, int bytes);
+    void recordSent(int packetType, int bytes);
+    void recordParseError();
+    void recordEventReceived(const QString &name, int bytes);
+    void recordEventEmitted(const QString &name, int bytes);
+    void recordAckRequested();
+    void recordAckReceived(qint64 emittedAt);
+    void recordAckTimedOut();
+    void recordAckFailed();
+    void recordHandshake(qint64 microseconds);
+
+    //nanoseconds on the clock that recordAckReceived() expects
+    qint64 now() const;
+
+    QSocketIoMetricsSnapshot snapshot() const;
+
+private:
+    Q_DISABLE_COPY(QSocketIoMetrics)
+
+    struct EventCounters
+    {
+        QString name;
+        QAtomicInteger<quint64> received;
+        QAtomicInteger<quint64> receivedBytes;
+        QAtomicInteger<quint64> emitted;
+        QAtomicInteger<quint64> emittedBytes;
+        EventCounters *next;
+    };
+
+    EventCounters *countersFor(const QString &name);
+
+    QAtomicInteger<quint64> m_framesReceived[QSocketIoMetricsSnapshot::PacketTypeCount];
+    QAtomicInteger<quint64> m_bytesReceived[QSocketIoMetricsSnapshot::PacketTypeCount];
+    QAtomicInteger<quint64> m_framesSent[QSocketIoMetricsSnapshot::PacketTypeCount];
+    QAtomicInteger<quint64> m_bytesSent[QSocketIoMetricsSnapshot::PacketTypeCount];
+    QAtomicInteger<quint64> m_parseErrors;
+    QAtomicInteger<quint64> m_acksRequested;
+    QAtomicInteger<quint64> m_acksReceived;
+    QAtomicInteger<quint64> m_acksTimedOut;
+    QAtomicInteger<quint64> m_acksFailed;
+    QSocketIoHistogramRecorder m_ackLatency;
+    QSocketIoHistogramRecorder m_handshakeDuration;
+    QElapsedTimer m_clock;
+    QAtomicPointer<EventCounters> m_pEvents;
+    QHash<QString, EventCounters *> m_eventIndex;   //I/O thread only
+    EventCounters *m_pOtherEvents;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOMETRICS_P_H
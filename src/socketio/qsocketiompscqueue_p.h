@@ -0,0 +1,90 @@
+#ifndef QSOCKETIOMPSCQUEUE_P_H
+#define QSOCKETIOMPSCQUEUE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QAtomicPointer>
+#include <utility>
+
+QT_BEGIN_NAMESPACE
+
+//An unbounded multi-producer single-consumer queue. Any thread can
+//enqueue without taking a lock: a producer swaps itself in as the new head
+//and then links the previous head to it. Only one thread may dequeue. A
+//producer that has swapped the head but not linked it yet briefly hides
+//the nodes behind it, so dequeue() can report an empty queue while an
+//enqueue() is still in progress.
+template <typename T>
+class QSocketIoMpscQueue
+{
+public:
+    QSocketIoMpscQueue() :
+        m_pHead(&m_stub),
+        m_pTail(&m_stub),
+        m_stub()
+    {
+    }
+
+    ~QSocketIoMpscQueue()
+    {
+        T value;
+        while (dequeue(&value)) {
+        }
+        if (m_pTail != &m_stub) {
+            delete m_pTail;
+        }
+    }
+
+    void enqueue(T value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *previous = m_pHead.fetchAndStoreOrdered(node);
+        previous->next.storeRelease(node);
+    }
+
+    //consumer thread only
+    bool dequeue(T *value)
+    {
+        Node *tail = m_pTail;
+        Node *next = tail->next.loadAcquire();
+        if (!next) {
+            return false;
+        }
+        //next becomes the new stub; its value is moved out right away
+        *value = std::move(next->value);
+        m_pTail = next;
+        if (tail != &m_stub) {
+            delete tail;
+        }
+        return true;
+    }
+
+private:
+    Q_DISABLE_COPY(QSocketIoMpscQueue)
+
+    struct Node
+    {
+        Node() : next(Q_NULLPTR), value() {}
+        explicit Node(T &&value) : next(Q_NULLPTR), value(std::move(value)) {}
+
+        QAtomicPointer<Node> next;
+        T value;
+    };
+
+    QAtomicPointer<Node> m_pHead;   //written by producers
+    Node *m_pTail;                  //owned by the consumer
+    Node m_stub;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOMPSCQUEUE_P_H
@@ -0,0 +1,458 @@
+#include "qsocketionamespace.h"
+#include "qsocketioclient.h"
+#include "qsocketioacktable_p.h"
+#include "qsocketiothreading_p.h"
+#include "qsocketiometrics_p.h"
+#include "qsocketiotrace_p.h"
+#include "qsocketioattachments_p.h"
+#include <QtCore/QThread>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include <QtCore/QDebug>
+
+QSocketIoNamespace::QSocketIoNamespace(QSocketIoClient *client, const QString &endpoint,
+                                       QObject *parent) :
+    QObject(parent),
+    m_pClient(client),
+    m_endpoint(endpoint),
+    m_pAckTable(new QSocketIoAckTable()),
+    m_pAckTimer(new QTimer(this)),
+    m_ackTimeout(-1),
+    m_subscriptions(),
+    m_subscriptionEvents(),
+    m_anySubscriptions(),
+    m_lastSubscriptionId(0)
+{
+    m_pAckTimer->setInterval(QSocketIoAckTable::TickInterval);
+    connect(m_pAckTimer, SIGNAL(timeout()), this, SLOT(onAckTimeout()));
+}
+
+QSocketIoNamespace::~QSocketIoNamespace()
+{
+    m_pAckTimer->stop();
+    delete m_pAckTimer;
+    delete m_pAckTable;
+}
+
+QString QSocketIoNamespace::endpoint() const
+{
+    return m_endpoint;
+}
+
+QSocketIoClient *QSocketIoNamespace::client() const
+{
+    return m_pClient;
+}
+
+void QSocketIoNamespace::emitMessage(const QString &message, bool value)
+{
+    emitEvent(message, value);
+}
+
+void QSocketIoNamespace::emitMessage(const QString &message, int value)
+{
+    emitEvent(message, value);
+}
+
+void QSocketIoNamespace::emitMessage(const QString &message, double value)
+{
+    emitEvent(message, value);
+}
+
+void QSocketIoNamespace::emitMessage(const QString &message, const QString &value)
+{
+    emitEvent(message, value);
+}
+
+void QSocketIoNamespace::emitMessage(const QString &message, const QVariantList &arguments)
+{
+    emitEvent(message, arguments);
+}
+
+void QSocketIoNamespace::emitMessage(const QString &message, const QVariantMap &arguments)
+{
+    emitEvent(message, arguments);
+}
+
+//for state that is only interesting in its latest value: dropped while there
+//is no connection, and replacing older values of the same event that were
+//not written yet. Volatile emits can't be acknowledged.
+void QSocketIoNamespace::emitVolatile(const QString &message, const QVariant &arguments)
+{
+    if (m_pClient->mustQueue()) {
+        QSocketIoOutbound item;
+        item.target = this;
+        item.message = message;
+        item.arguments = arguments;
+        item.isVolatile = true;
+        m_pClient->postOutbound(std::move(item));
+        return;
+    }
+    m_pClient->doEmitVolatile(message, arguments, m_endpoint);
+}
+
+//emits from other threads than the I/O thread are queued for it as they are
+void QSocketIoNamespace::emitEvent(const QString &message, const QVariant &arguments)
+{
+    QSOCKETIO_TRACE_SPAN("emitMessage");
+    if (m_pClient->mustQueue()) {
+        QSocketIoOutbound item;
+        item.target = this;
+        item.message = message;
+        item.arguments = arguments;
+        m_pClient->waitWhileCongested();
+        m_pClient->postOutbound(std::move(item));
+        return;
+    }
+    if (m_pClient->m_pJournal) {
+        m_pClient->doEmitJournaled(message, arguments, m_endpoint);
+        return;
+    }
+    m_pClient->doEmitMessage(m_pClient->nextMessageId(), message, arguments, m_endpoint, true);
+}
+
+//the emit is refused when the ack table has no room for another pending ack;
+//a queued emit is always accepted and reports a refusal through errorCallback
+bool QSocketIoNamespace::emitWithAck(const QString &message, const QVariant &arguments,
+                                     QSocketIo::Callback callback,
+                                     QSocketIo::ErrorCallback errorCallback, int timeout)
+{
+    QSOCKETIO_TRACE_SPAN("emitMessage");
+    if (m_pClient->mustQueue()) {
+        QSocketIoOutbound item;
+        item.target = this;
+        item.message = message;
+        item.arguments = arguments;
+        item.acknowledged = true;
+        item.callback = std::move(callback);
+        item.errorCallback = std::move(errorCallback);
+        item.timeout = timeout;
+        m_pClient->waitWhileCongested();
+        m_pClient->postOutbound(std::move(item));
+        return true;
+    }
+
+    int messageId = m_pClient->nextMessageId();
+    //after a wrap, skip ids whose ack is still pending rather than
+    //routing two acks to the same callback; this terminates because the
+    //table has a free slot whenever it is not full
+    while (!m_pAckTable->canInsert(messageId) && !m_pAckTable->isFull()) {
+        messageId = m_pClient->nextMessageId();
+    }
+    if (!m_pAckTable->canInsert(messageId)) {
+        reportError(errorCallback, QSocketIo::AckLimitError);
+        return false;
+    }
+    QSocketIoMetrics *metrics = m_pClient->m_pMetrics;
+    m_pAckTable->insert(messageId, std::move(callback), std::move(errorCallback), timeout,
+                        metrics ? metrics->now() : 0);
+    const QSocketIoClient::EmitResult result = m_pClient->doEmitMessage(messageId, message,
+                                                                        arguments, m_endpoint,
+                                                                        true);
+    if (result != QSocketIoClient::EmitQueued) {
+        //without a connection the reconnect buffer is full; with one, the
+        //overflow policy refused or dropped the emit
+        QSocketIoAckTable::Entry entry;
+        m_pAckTable->take(messageId, &entry);
+        reportError(entry.errorCallback, result == QSocketIoClient::EmitNotConnected
+                    ? QSocketIo::AckLimitError : QSocketIo::AckQueueFullError);
+        return false;
+    }
+    if (m_pAckTable->hasTimeouts() && !m_pAckTimer->isActive()) {
+        m_pAckTimer->start();
+    }
+    if (metrics) {
+        metrics->recordAckRequested();
+    }
+    return true;
+}
+
+void QSocketIoNamespace::acknowledge(int messageId, const QJsonValue &retVal)
+{
+    m_pClient->sendAck(m_endpoint, messageId, retVal);
+}
+
+//replies can come from any thread; from another thread than the client's
+//one they are always queued to it, with or without an I/O thread. The
+//message id means nothing to the server of another session
+void QSocketIoNamespace::acknowledge(int messageId, const QString &sessionId,
+                                     const QJsonArray &arguments)
+{
+    if (QThread::currentThread() == m_pClient->thread()) {
+        if (m_pClient->sessionId() == sessionId) {
+            acknowledge(messageId, arguments);
+        }
+        return;
+    }
+    const QPointer<QSocketIoNamespace> target(this);
+    QSocketIoOutbound item;
+    item.task = [target, messageId, sessionId, arguments]() {
+        if (target && target->m_pClient->sessionId() == sessionId) {
+            target->acknowledge(messageId, arguments);
+        }
+    };
+    m_pClient->postOutbound(std::move(item));
+}
+
+//callbacks run in the client's callback thread, right away when that is
+//the current one
+template <typename Task>
+void QSocketIoNamespace::deliver(Task task)
+{
+    if (m_pClient->isCallbackThread()) {
+        task();
+    } else {
+        m_pClient->postCallback(QSocketIoTask(std::move(task)));
+    }
+}
+
+void QSocketIoNamespace::reportError(const QSocketIo::ErrorCallback &errorCallback,
+                                     QSocketIo::AckError error)
+{
+    if (!errorCallback.isNull()) {
+        deliver([errorCallback, error]() {
+            errorCallback(error);
+        });
+    }
+}
+
+//acks requested on a lost connection will never arrive: the server forgets
+//them together with the session
+//for an emit that was accepted, and dropped before it was written
+void QSocketIoNamespace::failAck(int messageId, QSocketIo::AckError error)
+{
+    QSocketIoAckTable::Entry entry;
+    if (!m_pAckTable->take(messageId, &entry)) {
+        return;
+    }
+    if (!m_pAckTable->hasTimeouts()) {
+        m_pAckTimer->stop();
+    }
+    if (m_pClient->m_pMetrics) {
+        m_pClient->m_pMetrics->recordAckFailed();
+    }
+    reportError(entry.errorCallback, error);
+}
+
+void QSocketIoNamespace::abortPendingAcks(QSocketIo::AckError error)
+{
+    QVector<QSocketIoAckTable::Entry> entries;
+    m_pAckTable->takeAll(&entries);
+    m_pAckTimer->stop();
+    for (QVector<QSocketIoAckTable::Entry>::const_iterator it = entries.constBegin();
+         it != entries.constEnd(); ++it) {
+        if (m_pClient->m_pMetrics) {
+            m_pClient->m_pMetrics->recordAckFailed();
+        }
+        reportError(it->errorCallback, error);
+    }
+}
+
+//handlers may hold responders, which still need the client when they go
+void QSocketIoNamespace::clearCallbacks()
+{
+    for (QHash<QString, QVector<Subscription> >::const_iterator it = m_subscriptions.constBegin();
+         it != m_subscriptions.constEnd(); ++it) {
+        for (int i = 0; i < it.value().size(); ++i) {
+            it.value().at(i).active->storeRelease(0);
+        }
+    }
+    for (int i = 0; i < m_anySubscriptions.size(); ++i) {
+        m_anySubscriptions.at(i).active->storeRelease(0);
+    }
+    m_subscriptions.clear();
+    m_subscriptionEvents.clear();
+    m_anySubscriptions.clear();
+    QVector<QSocketIoAckTable::Entry> entries;
+    m_pAckTable->takeAll(&entries);
+}
+
+void QSocketIoNamespace::setAckTimeout(int msecs)
+{
+    m_ackTimeout = msecs;
+}
+
+int QSocketIoNamespace::ackTimeout() const
+{
+    return m_ackTimeout;
+}
+
+void QSocketIoNamespace::setMaximumPendingAcks(int maximum)
+{
+    m_pAckTable->setMaximumPending(maximum);
+}
+
+int QSocketIoNamespace::maximumPendingAcks() const
+{
+    return m_pAckTable->maximumPending();
+}
+
+int QSocketIoNamespace::pendingAcks() const
+{
+    return m_pAckTable->size();
+}
+
+void QSocketIoNamespace::ackReceived(int messageId, QJsonArray arguments)
+{
+    QSocketIoAckTable::Entry entry;
+    if (m_pAckTable->take(messageId, &entry)) {
+        if (!m_pAckTable->hasTimeouts()) {
+            m_pAckTimer->stop();
+        }
+        if (m_pClient->m_pMetrics) {
+            m_pClient->m_pMetrics->recordAckReceived(entry.emittedAt);
+        }
+        QSocketIo::Callback callback = std::move(entry.callback);
+        deliver([callback, arguments]() {
+            QSOCKETIO_TRACE_SPAN("ackCallback");
+            callback(arguments, Q_NULLPTR);
+        });
+    }
+}
+
+void QSocketIoNamespace::onAckTimeout()
+{
+    QVector<QSocketIoAckTable::Entry> expired;
+    m_pAckTable->expire(&expired);
+    if (!m_pAckTable->hasTimeouts()) {
+        m_pAckTimer->stop();
+    }
+    for (QVector<QSocketIoAckTable::Entry>::const_iterator it = expired.constBegin();
+         it != expired.constEnd(); ++it) {
+        if (m_pClient->m_pMetrics) {
+            m_pClient->m_pMetrics->recordAckTimedOut();
+        }
+        reportError(it->errorCallback, QSocketIo::AckTimeoutError);
+    }
+}
+
+void QSocketIoNamespace::eventReceived(QString message, QJsonArray arguments,
+                                       bool mustAck, int messageId,
+                                       QVector<QByteArray> attachments)
+{
+    QSOCKETIO_TRACE_SPAN("eventReceived");
+    //the first handler that returns a value or replies through its
+    //responder answers the server; without one, the acknowledgement is sent
+    //empty once the last copy of the responder is gone
+    QSocketIoResponder responder;
+    if (mustAck) {
+        responder = QSocketIoResponder(this, messageId);
+    }
+
+    //dispatch over copies, so that handlers can subscribe and unsubscribe
+    //while an event is being delivered; handlers that were unsubscribed in
+    //the meantime are skipped. Handlers added in the meantime only see the
+    //next event.
+    const QVector<Subscription> subscriptions = m_subscriptions.value(message);
+    const QVector<AnySubscription> anySubscriptions = m_anySubscriptions;
+    if (subscriptions.isEmpty() && anySubscriptions.isEmpty()) {
+        return;
+    }
+    deliver([subscriptions, anySubscriptions, message, arguments, attachments, responder,
+             mustAck]() mutable {
+        QSOCKETIO_TRACE_SPAN("callback");
+        QSocketIoAttachmentScope scope(&attachments);
+        QSocketIoResponder *pResponder = mustAck ? &responder : Q_NULLPTR;
+        for (QVector<Subscription>::const_iterator it = subscriptions.constBegin();
+             it != subscriptions.constEnd(); ++it) {
+            if (it->active->loadAcquire()) {
+                it->callback(arguments, pResponder);
+            }
+        }
+        for (QVector<AnySubscription>::const_iterator it = anySubscriptions.constBegin();
+             it != anySubscriptions.constEnd(); ++it) {
+            if (it->active->loadAcquire()) {
+                it->callback(message, arguments);
+            }
+        }
+    });
+}
+
+int QSocketIoNamespace::addSubscription(const QString &event, QSocketIo::Callback callback)
+{
+    Subscription subscription;
+    subscription.id = ++m_lastSubscriptionId;
+    subscription.callback = std::move(callback);
+    subscription.active = QSharedPointer<QAtomicInt>::create(1);
+    m_subscriptions[event].append(subscription);
+    m_subscriptionEvents.insert(subscription.id, event);
+    return subscription.id;
+}
+
+//subscribes a slot or invokable method; member can be given with SLOT().
+//Returns -1 when the receiver has no such method.
+int QSocketIoNamespace::on(const QString &event, const QObject *receiver, const char *member,
+                           Qt::ConnectionType type)
+{
+    return on(event, receiver, SlotCallback::findMethod(receiver, member), type);
+}
+
+int QSocketIoNamespace::on(const QString &event, const QObject *receiver,
+                           const QMetaMethod &method, Qt::ConnectionType type)
+{
+    if (!receiver || !method.isValid()
+            || method.parameterCount() > SlotCallback::MaximumParameters) {
+        qWarning() << "QSocketIoNamespace::on: invalid receiver method for event" << event;
+        return -1;
+    }
+    const int subscription = addSubscription(event, SlotCallback(receiver, method, type));
+    //the subscription goes together with its receiver
+    connect(receiver, &QObject::destroyed, this, [this, subscription]() {
+        off(subscription);
+    });
+    return subscription;
+}
+
+int QSocketIoNamespace::addAnySubscription(QSocketIo::EventCallback callback)
+{
+    AnySubscription subscription;
+    subscription.id = ++m_lastSubscriptionId;
+    subscription.callback = std::move(callback);
+    subscription.active = QSharedPointer<QAtomicInt>::create(1);
+    m_anySubscriptions.append(subscription);
+    return subscription.id;
+}
+
+//takes effect right away: the handler is not called anymore, not even for
+//an event that is being delivered or waits in the callback thread
+void QSocketIoNamespace::off(int subscription)
+{
+    QHash<int, QString>::iterator eventIt = m_subscriptionEvents.find(subscription);
+    if (eventIt == m_subscriptionEvents.end()) {
+        for (int i = 0; i < m_anySubscriptions.size(); ++i) {
+            if (m_anySubscriptions.at(i).id == subscription) {
+                m_anySubscriptions.at(i).active->storeRelease(0);
+                m_anySubscriptions.remove(i);
+                break;
+            }
+        }
+        return;
+    }
+
+    QHash<QString, QVector<Subscription> >::iterator it = m_subscriptions.find(eventIt.value());
+    m_subscriptionEvents.erase(eventIt);
+    if (it == m_subscriptions.end()) {
+        return;
+    }
+    QVector<Subscription> &subscriptions = it.value();
+    for (int i = 0; i < subscriptions.size(); ++i) {
+        if (subscriptions.at(i).id == subscription) {
+            subscriptions.at(i).active->storeRelease(0);
+            subscriptions.remove(i);
+            break;
+        }
+    }
+    if (subscriptions.isEmpty()) {
+        m_subscriptions.erase(it);
+    }
+}
+
+void QSocketIoNamespace::off(const QString &event)
+{
+    const QVector<Subscription> subscriptions = m_subscriptions.take(event);
+    for (QVector<Subscription>::const_iterator it = subscriptions.constBegin();
+         it != subscriptions.constEnd(); ++it) {
+        it->active->storeRelease(0);
+        m_subscriptionEvents.remove(it->id);
+    }
+}
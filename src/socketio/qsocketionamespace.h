@@ -0,0 +1,223 @@
+#ifndef QSOCKETIONAMESPACE_H
+#define QSOCKETIONAMESPACE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QAtomicInt>
+#include "qsocketio_global.h"
+#include "qcallback.h"
+
+QT_BEGIN_NAMESPACE
+
+class QTimer;
+class QSocketIoClient;
+class QSocketIoAckTable;
+
+//A socket.io endpoint. Namespaces obtained with QSocketIoClient::of() share
+//the socket, heartbeat and session of their client, but keep their own
+//subscriptions and pending acks. The client itself is the root namespace.
+//With the client on its I/O thread, the emits are safe to call from any
+//thread; everything else belongs to the I/O thread.
+class Q_SOCKETIO_EXPORT QSocketIoNamespace : public QObject
+{
+    Q_OBJECT
+public:
+    virtual ~QSocketIoNamespace();
+
+    QString endpoint() const;
+    QSocketIoClient *client() const;
+
+    //without a callback, an emit that the client can't take is lost without
+    //notice: see QSocketIoClient::OverflowPolicy and reconnectBufferSize()
+    void emitMessage(const QString &message, bool value);
+    void emitMessage(const QString &message, int value);
+    void emitMessage(const QString &message, double value);
+    void emitMessage(const QString &message, const QString &value);
+    void emitMessage(const QString &message, const QVariantList &arguments);
+    void emitMessage(const QString &message, const QVariantMap &arguments);
+    void emitVolatile(const QString &message, const QVariant &arguments);
+
+    template <typename Callback>
+    bool emitMessage(const QString &message, bool value, Callback callback);
+    template <typename Callback>
+    bool emitMessage(const QString &message, int value, Callback callback);
+    template <typename Callback>
+    bool emitMessage(const QString &message, double value, Callback callback);
+    template <typename Callback>
+    bool emitMessage(const QString &message, const QString &value, Callback callback);
+    template <typename Callback>
+    bool emitMessage(const QString &message, const QVariantList &value, Callback callback);
+    template <typename Callback>
+    bool emitMessage(const QString &message, const QVariantMap &value, Callback callback);
+    template <typename Callback, typename ErrorCallback>
+    bool emitMessage(const QString &message, const QVariant &value, Callback callback,
+                     ErrorCallback errorCallback, int timeout = -1);
+
+    int on(const QString &event, const QObject *receiver, const char *member,
+           Qt::ConnectionType type = Qt::AutoConnection);
+    int on(const QString &event, const QObject *receiver, const QMetaMethod &method,
+           Qt::ConnectionType type = Qt::AutoConnection);
+    template <typename Callback>
+    typename std::enable_if<function_traits<Callback>::is_function, int>::type
+    on(const QString &event, Callback callback);
+    template <typename Callback>
+    typename std::enable_if<function_traits<Callback>::is_function, int>::type
+    onAny(Callback callback);
+    void off(int subscription);
+    void off(const QString &event);
+
+    void setAckTimeout(int msecs);
+    int ackTimeout() const;
+    void setMaximumPendingAcks(int maximum);
+    int maximumPendingAcks() const;
+    int pendingAcks() const;
+
+Q_SIGNALS:
+    void messageReceived(QString message);
+    void connected(QString endpoint);
+    void disconnected(QString endpoint);
+
+protected:
+    QSocketIoNamespace(QSocketIoClient *client, const QString &endpoint,
+                       QObject *parent = Q_NULLPTR);
+
+private Q_SLOTS:
+    void onAckTimeout();
+
+private:
+    Q_DISABLE_COPY(QSocketIoNamespace)
+    friend class QSocketIoClient;
+    friend struct QSocketIoResponderState;
+
+    //active is shared with the copies that deliveries take, and cleared by
+    //off(): the callback thread tests it without touching the namespace
+    struct Subscription
+    {
+        int id;
+        QSocketIo::Callback callback;
+        QSharedPointer<QAtomicInt> active;
+    };
+    struct AnySubscription
+    {
+        int id;
+        QSocketIo::EventCallback callback;
+        QSharedPointer<QAtomicInt> active;
+    };
+
+    QSocketIoClient *m_pClient;
+    QString m_endpoint;
+    QSocketIoAckTable *m_pAckTable;
+    QTimer *m_pAckTimer;
+    int m_ackTimeout;
+    QHash<QString, QVector<Subscription> > m_subscriptions;
+    QHash<int, QString> m_subscriptionEvents;
+    QVector<AnySubscription> m_anySubscriptions;
+    int m_lastSubscriptionId;
+
+    void emitEvent(const QString &message, const QVariant &arguments);
+    bool emitWithAck(const QString &message, const QVariant &arguments,
+                     QSocketIo::Callback callback, QSocketIo::ErrorCallback errorCallback,
+                     int timeout);
+
+    void acknowledge(int messageId, const QJsonValue &retVal = QJsonValue());
+    void acknowledge(int messageId, const QString &sessionId, const QJsonArray &arguments);
+    void abortPendingAcks(QSocketIo::AckError error);
+    void failAck(int messageId, QSocketIo::AckError error);
+    void clearCallbacks();
+
+    template <typename Task>
+    void deliver(Task task);
+    void reportError(const QSocketIo::ErrorCallback &errorCallback, QSocketIo::AckError error);
+
+    int addSubscription(const QString &event, QSocketIo::Callback callback);
+    int addAnySubscription(QSocketIo::EventCallback callback);
+
+    void ackReceived(int messageId, QJsonArray arguments);
+    void eventReceived(QString message, QJsonArray arguments, bool mustAck, int messageId,
+                       QVector<QByteArray> attachments);
+};
+
+template <typename Callback>
+typename std::enable_if<function_traits<Callback>::is_function, int>::type
+QSocketIoNamespace::on(const QString &event, Callback callback)
+{
+    return addSubscription(event, TypedCallback<Callback>(callback));
+}
+
+template <typename Callback>
+typename std::enable_if<function_traits<Callback>::is_function, int>::type
+QSocketIoNamespace::onAny(Callback callback)
+{
+    return addAnySubscription(callback);
+}
+
+template <typename Callback>
+bool QSocketIoNamespace::emitMessage(const QString &message,
+                                     bool value, Callback callback)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(), m_ackTimeout);
+}
+
+template <typename Callback>
+bool QSocketIoNamespace::emitMessage(const QString &message,
+                                     int value, Callback callback)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(), m_ackTimeout);
+}
+
+template <typename Callback>
+bool QSocketIoNamespace::emitMessage(const QString &message,
+                                     double value, Callback callback)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(), m_ackTimeout);
+}
+
+template <typename Callback>
+bool QSocketIoNamespace::emitMessage(const QString &message,
+                                     const QString &value, Callback callback)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(), m_ackTimeout);
+}
+
+template <typename Callback>
+bool QSocketIoNamespace::emitMessage(const QString &message,
+                                     const QVariantList &value, Callback callback)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(), m_ackTimeout);
+}
+
+template <typename Callback>
+bool QSocketIoNamespace::emitMessage(const QString &message,
+                                     const QVariantMap &value, Callback callback)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(), m_ackTimeout);
+}
+
+//the error callback is called with a QSocketIo::AckError when no ack
+//arrived within timeout milliseconds (-1 uses ackTimeout()), when the
+//connection was lost before the ack arrived, or right away when too many
+//acks or emits are pending, in which case the emit is refused. An emit that
+//the congested outbound queue refuses or drops fails with AckQueueFullError.
+template <typename Callback, typename ErrorCallback>
+bool QSocketIoNamespace::emitMessage(const QString &message, const QVariant &value,
+                                     Callback callback, ErrorCallback errorCallback, int timeout)
+{
+    return emitWithAck(message, value, TypedCallback<Callback>(callback),
+                       QSocketIo::ErrorCallback(errorCallback),
+                       timeout < 0 ? m_ackTimeout : timeout);
+}
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIONAMESPACE_H
@@ -0,0 +1,57 @@
+#ifndef QSOCKETIOPOOLWORKER_P_H
+#define QSOCKETIOPOOLWORKER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+#include "qsocketioclientpool.h"
+
+QT_BEGIN_NAMESPACE
+
+class QNetworkAccessManager;
+
+//Lives in one worker thread of a QSocketIoClientPool, next to the clients
+//it keeps the books for. The counters are only touched in that thread;
+//the pool reads them through a blocking collect().
+class QSocketIoPoolWorker : public QObject
+{
+    Q_OBJECT
+public:
+    QSocketIoPoolWorker();
+
+    QNetworkAccessManager *networkAccessManager() const;
+    void addClient(QSocketIoClient *client);
+
+    QSocketIoPoolStatistics statistics() const;
+
+public Q_SLOTS:
+    void collect();
+    void shutdown();
+
+private Q_SLOTS:
+    void onConnected(QString endpoint);
+    void onDisconnected(QString endpoint);
+    void onReconnectFailed();
+
+private:
+    Q_DISABLE_COPY(QSocketIoPoolWorker)
+
+    QNetworkAccessManager *m_pNetworkAccessManager;
+    QVector<QSocketIoClient *> m_clients;
+    QSocketIoPoolStatistics m_statistics;
+    QSocketIoPoolStatistics m_collected;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOPOOLWORKER_P_H
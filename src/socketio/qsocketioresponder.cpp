@@ -0,0 +1,56 @@
+#include "qsocketioresponder.h"
+#include "qsocketionamespace.h"
+#include "qsocketioclient.h"
+#include <QtCore/QPointer>
+#include <QtCore/QAtomicInt>
+
+struct QSocketIoResponderState
+{
+    QSocketIoResponderState(QSocketIoNamespace *socketNamespace, int messageId) :
+        socketNamespace(socketNamespace),
+        messageId(messageId),
+        sessionId(socketNamespace->client()->sessionId()),
+        replied(0)
+    {}
+
+    ~QSocketIoResponderState()
+    {
+        send(QJsonArray());
+    }
+
+    //only the first reply gets through, whichever thread it comes from
+    void send(const QJsonArray &arguments)
+    {
+        if (replied.testAndSetOrdered(0, 1) && socketNamespace) {
+            socketNamespace->acknowledge(messageId, sessionId, arguments);
+        }
+    }
+
+    QPointer<QSocketIoNamespace> socketNamespace;
+    int messageId;
+    QString sessionId;
+    QAtomicInt replied;
+};
+
+QSocketIoResponder::QSocketIoResponder() :
+    m_pState()
+{
+}
+
+QSocketIoResponder::QSocketIoResponder(QSocketIoNamespace *socketNamespace, int messageId) :
+    m_pState(new QSocketIoResponderState(socketNamespace, messageId))
+{
+}
+
+//true when the server is still waiting for this acknowledgement
+bool QSocketIoResponder::isValid() const
+{
+    return m_pState && !m_pState->replied.loadAcquire();
+}
+
+void QSocketIoResponder::reply(const QJsonArray &arguments)
+{
+    if (m_pState) {
+        m_pState->send(arguments);
+    }
+}
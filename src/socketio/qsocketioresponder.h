@@ -0,0 +1,40 @@
+#ifndef QSOCKETIORESPONDER_H
+#define QSOCKETIORESPONDER_H
+
+#include <QtCore/QSharedPointer>
+#include <QtCore/QJsonArray>
+#include "qsocketio_global.h"
+
+QT_BEGIN_NAMESPACE
+
+class QSocketIoNamespace;
+struct QSocketIoResponderState;
+
+//Sends the acknowledgement of an event for which the server asked for
+//data. An event handler that takes a QSocketIoResponder as its last
+//parameter can keep it and reply later. Copies share the acknowledgement,
+//so only the first reply is sent; when the last copy goes away without a
+//reply, an empty acknowledgement is sent instead. Replies made after the
+//session was lost are dropped. A responder can be replied to from any
+//thread, as long as its client exists; a reply made from another thread
+//than the client's one is sent from the client's thread, so that thread
+//must run an event loop.
+class Q_SOCKETIO_EXPORT QSocketIoResponder
+{
+public:
+    QSocketIoResponder();
+
+    bool isValid() const;
+    void reply(const QJsonArray &arguments = QJsonArray());
+
+private:
+    friend class QSocketIoNamespace;
+
+    QSocketIoResponder(QSocketIoNamespace *socketNamespace, int messageId);
+
+    QSharedPointer<QSocketIoResponderState> m_pState;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIORESPONDER_H
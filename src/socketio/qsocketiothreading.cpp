@@ -0,0 +1,32 @@
+#include "qsocketiothreading_p.h"
+
+QSocketIoCallbackEvent::QSocketIoCallbackEvent(QSocketIoTask task) :
+    QEvent(eventType()),
+    m_task(std::move(task))
+{
+}
+
+void QSocketIoCallbackEvent::run()
+{
+    m_task();
+}
+
+QEvent::Type QSocketIoCallbackEvent::eventType()
+{
+    static const int type = QEvent::registerEventType();
+    return QEvent::Type(type);
+}
+
+QSocketIoCallbackReceiver::QSocketIoCallbackReceiver() :
+    QObject()
+{
+}
+
+bool QSocketIoCallbackReceiver::event(QEvent *event)
+{
+    if (event->type() == QSocketIoCallbackEvent::eventType()) {
+        static_cast<QSocketIoCallbackEvent *>(event)->run();
+        return true;
+    }
+    return QObject::event(event);
+}
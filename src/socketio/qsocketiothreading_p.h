@@ -0,0 +1,71 @@
+#ifndef QSOCKETIOTHREADING_P_H
+#define QSOCKETIOTHREADING_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/QObject>
+#include <QtCore/QEvent>
+#include <QtCore/QPointer>
+#include <QtCore/QVariant>
+#include "qcallback.h"
+
+QT_BEGIN_NAMESPACE
+
+class QSocketIoNamespace;
+
+typedef InplaceCallback<void()> QSocketIoTask;
+
+//work handed to the I/O thread by other threads; emits are queued as data
+//so that the common case doesn't need a closure on the heap
+struct QSocketIoOutbound
+{
+    QSocketIoOutbound() :
+        target(), message(), arguments(), acknowledged(false), isVolatile(false),
+        callback(), errorCallback(), timeout(-1), task()
+    {}
+
+    QPointer<QSocketIoNamespace> target;
+    QString message;
+    QVariant arguments;
+    bool acknowledged;
+    bool isVolatile;
+    QSocketIo::Callback callback;
+    QSocketIo::ErrorCallback errorCallback;
+    int timeout;
+    QSocketIoTask task;     //anything else; runs instead of an emit when set
+};
+
+class QSocketIoCallbackEvent : public QEvent
+{
+public:
+    explicit QSocketIoCallbackEvent(QSocketIoTask task);
+
+    void run();
+
+    static QEvent::Type eventType();
+
+private:
+    QSocketIoTask m_task;
+};
+
+//lives in the thread that callbacks are delivered to
+class QSocketIoCallbackReceiver : public QObject
+{
+public:
+    QSocketIoCallbackReceiver();
+
+    bool event(QEvent *event) Q_DECL_OVERRIDE;
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOTHREADING_P_H
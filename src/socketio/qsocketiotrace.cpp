@@ -0,0 +1,201 @@
+#include "qsocketiotrace_p.h"
+
+#ifdef QT_SOCKETIO_TRACE
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+namespace
+{
+struct TraceEvent
+{
+    const char *name;
+    qint64 begin;   //nanoseconds since the first trace point
+    qint64 end;
+};
+
+struct TraceBuffer
+{
+    enum { Capacity = 16384 };  //a power of two
+
+    TraceBuffer() : threadId(0), threadName(), written(0) {}
+
+    int threadId;
+    QByteArray threadName;
+    QAtomicInteger<quint32> written;    //only the owning thread adds to it
+    TraceEvent events[Capacity];
+};
+
+struct TraceClock
+{
+    TraceClock() { timer.start(); }
+
+    QElapsedTimer timer;
+};
+
+QElapsedTimer &traceClock()
+{
+    static TraceClock clock;
+    return clock.timer;
+}
+
+QMutex &registryMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+//buffers outlive their threads, so that spans of finished threads can
+//still be dumped
+QVector<TraceBuffer *> &registry()
+{
+    static QVector<TraceBuffer *> buffers;
+    return buffers;
+}
+
+thread_local TraceBuffer *currentBuffer = Q_NULLPTR;
+
+TraceBuffer *threadBuffer()
+{
+    if (!currentBuffer) {
+        TraceBuffer *buffer = new TraceBuffer();
+        QThread *thread = QThread::currentThread();
+        buffer->threadName = thread ? thread->objectName().toUtf8() : QByteArray();
+        QMutexLocker locker(&registryMutex());
+        buffer->threadId = registry().size() + 1;
+        registry().append(buffer);
+        currentBuffer = buffer;
+    }
+    return currentBuffer;
+}
+
+void appendEscaped(QByteArray *out, const QByteArray &value)
+{
+    for (int i = 0; i < value.size(); ++i) {
+        const char c = value.at(i);
+        if (c == '"' || c == '\\') {
+            out->append('\\');
+        }
+        if (uchar(c) >= 0x20) {
+            out->append(c);
+        }
+    }
+}
+}
+
+QAtomicInt QSocketIoTraceSpan::enabled(0);
+
+qint64 QSocketIoTraceSpan::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+void QSocketIoTraceSpan::record(const char *name, qint64 begin, qint64 end)
+{
+    TraceBuffer *buffer = threadBuffer();
+    const quint32 index = buffer->written.loadAcquire();
+    TraceEvent &event = buffer->events[index & (TraceBuffer::Capacity - 1)];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    //once the buffer is full it stays full: past 2^32 the count goes on
+    //from Capacity, which is the same slot
+    const quint32 next = index + 1;
+    buffer->written.storeRelease(next != 0 ? next : quint32(TraceBuffer::Capacity));
+}
+
+bool QSocketIoTrace::isCompiledIn()
+{
+    return true;
+}
+
+void QSocketIoTrace::setEnabled(bool enabled)
+{
+    if (enabled) {
+        (void)traceClock();  //start the clock before the first span
+    }
+    QSocketIoTraceSpan::enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool QSocketIoTrace::isEnabled()
+{
+    return QSocketIoTraceSpan::enabled.loadAcquire() != 0;
+}
+
+//threads that are recording at the same time may lose their latest spans
+void QSocketIoTrace::clear()
+{
+    QMutexLocker locker(&registryMutex());
+    for (int i = 0; i < registry().size(); ++i) {
+        registry().at(i)->written.storeRelease(0);
+    }
+}
+
+//best taken while the traced threads are quiet: a span that is being
+//overwritten while it is read can come out torn
+QByteArray QSocketIoTrace::toChromeTrace()
+{
+    QByteArray out("{\"traceEvents\":[");
+    bool first = true;
+    QMutexLocker locker(&registryMutex());
+    for (int i = 0; i < registry().size(); ++i) {
+        const TraceBuffer *buffer = registry().at(i);
+        const QByteArray tid = QByteArray::number(buffer->threadId);
+        if (!first) {
+            out.append(',');
+        }
+        first = false;
+        out.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":").append(tid)
+           .append(",\"args\":{\"name\":\"");
+        appendEscaped(&out, buffer->threadName.isEmpty()
+                      ? QByteArray("thread ") + tid : buffer->threadName);
+        out.append("\"}}");
+
+        const quint32 written = buffer->written.loadAcquire();
+        const quint32 count = qMin(written, quint32(TraceBuffer::Capacity));
+        for (quint32 j = written - count; j != written; ++j) {
+            const TraceEvent &event = buffer->events[j & (TraceBuffer::Capacity - 1)];
+            out.append(",{\"name\":\"");
+            appendEscaped(&out, QByteArray(event.name));
+            out.append("\",\"ph\":\"X\",\"pid\":1,\"tid\":").append(tid)
+               .append(",\"ts\":").append(QByteArray::number(event.begin / 1000.0, 'f', 3))
+               .append(",\"dur\":")
+               .append(QByteArray::number((event.end - event.begin) / 1000.0, 'f', 3))
+               .append('}');
+        }
+    }
+    out.append("]}");
+    return out;
+}
+
+#else
+
+bool QSocketIoTrace::isCompiledIn()
+{
+    return false;
+}
+
+void QSocketIoTrace::setEnabled(bool enabled)
+{
+    Q_UNUSED(enabled);
+}
+
+bool QSocketIoTrace::isEnabled()
+{
+    return false;
+}
+
+void QSocketIoTrace::clear()
+{
+}
+
+QByteArray QSocketIoTrace::toChromeTrace()
+{
+    return QByteArrayLiteral("{\"traceEvents\":[]}");
+}
+
+#endif // QT_SOCKETIO_TRACE
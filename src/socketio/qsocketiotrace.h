@@ -0,0 +1,31 @@
+#ifndef QSOCKETIOTRACE_H
+#define QSOCKETIOTRACE_H
+
+#include <QtCore/QByteArray>
+#include "qsocketio_global.h"
+
+QT_BEGIN_NAMESPACE
+
+//Spans recorded by the trace points on the hot paths of the module. The
+//trace points only exist when the module is built with
+//CONFIG += qsocketio_trace; without it they compile to nothing and
+//toChromeTrace() returns an empty trace. Even when built in, nothing is
+//recorded until tracing is enabled.
+class Q_SOCKETIO_EXPORT QSocketIoTrace
+{
+public:
+    static bool isCompiledIn();
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static void clear();
+
+    //the Chrome trace event format, for chrome://tracing or Perfetto
+    static QByteArray toChromeTrace();
+
+private:
+    QSocketIoTrace();
+};
+
+QT_END_NAMESPACE
+
+#endif // QSOCKETIOTRACE_H
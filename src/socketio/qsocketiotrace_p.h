@@ -0,0 +1,66 @@
+#ifndef QSOCKETIOTRACE_P_H
+#define QSOCKETIOTRACE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qsocketiotrace.h"
+
+#ifdef QT_SOCKETIO_TRACE
+
+#include <QtCore/QAtomicInt>
+
+QT_BEGIN_NAMESPACE
+
+//Every thread writes its spans to a ring buffer of its own, so recording
+//takes no lock; only the first span of a thread registers its buffer.
+class QSocketIoTraceSpan
+{
+public:
+    explicit QSocketIoTraceSpan(const char *name) :
+        m_name(name),
+        m_begin(enabled.loadAcquire() ? now() : -1)
+    {}
+
+    ~QSocketIoTraceSpan()
+    {
+        if (m_begin >= 0) {
+            record(m_name, m_begin, now());
+        }
+    }
+
+    static QAtomicInt enabled;
+
+    static qint64 now();
+    static void record(const char *name, qint64 begin, qint64 end);
+
+private:
+    Q_DISABLE_COPY(QSocketIoTraceSpan)
+
+    const char *m_name;     //a literal, only the pointer is stored
+    qint64 m_begin;
+};
+
+QT_END_NAMESPACE
+
+#define QSOCKETIO_TRACE_CONCAT2(a, b) a##b
+#define QSOCKETIO_TRACE_CONCAT(a, b) QSOCKETIO_TRACE_CONCAT2(a, b)
+//traces the rest of the enclosing scope
+#define QSOCKETIO_TRACE_SPAN(name) \
+    QSocketIoTraceSpan QSOCKETIO_TRACE_CONCAT(qsocketioTraceSpan, __LINE__)(name)
+
+#else
+
+#define QSOCKETIO_TRACE_SPAN(name) do {} while (false)
+
+#endif // QT_SOCKETIO_TRACE
+
+#endif // QSOCKETIOTRACE_P_H
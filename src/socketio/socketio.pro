@@ -5,10 +5,17 @@ TARGET = QtSocketIo
 QT = core network websockets
 CONFIG += c++11
 
+#deflate for compressed messages; see QSocketIoClient::setCompressionEnabled()
+qtConfig(system-zlib): QMAKE_USE_PRIVATE += zlib
+else: QT_PRIVATE += zlib-private
+
 TEMPLATE = lib
 
 DEFINES += QTSOCKETIO_LIBRARY QT_USE_STRINGBUILDER
 
+#trace points on the hot paths; see QSocketIoTrace
+qsocketio_trace: DEFINES += QT_SOCKETIO_TRACE
+
 #QMAKE_DOCS = $$PWD/doc/qtsocketio.qdocconfig
 #OTHER_FILES += doc/src/*.qdoc   # show .qdoc files in Qt Creator
 #OTHER_FILES += doc/snippets/*.cpp
@@ -16,12 +23,41 @@ DEFINES += QTSOCKETIO_LIBRARY QT_USE_STRINGBUILDER
 PUBLIC_HEADERS += \
     $$PWD/qsocketio_global.h \
     $$PWD/qsocketioclient.h \
+    $$PWD/qsocketioclientpool.h \
+    $$PWD/qsocketionamespace.h \
+    $$PWD/qsocketioresponder.h \
+    $$PWD/qsocketiometrics.h \
+    $$PWD/qsocketiotrace.h \
+    $$PWD/qsocketioframeparser.h \
     $$PWD/qcallback.h
 
-PRIVATE_HEADERS +=
+PRIVATE_HEADERS += \
+    $$PWD/qsocketioframewriter_p.h \
+    $$PWD/qsocketioacktable_p.h \
+    $$PWD/qsocketiompscqueue_p.h \
+    $$PWD/qsocketiothreading_p.h \
+    $$PWD/qsocketiopoolworker_p.h \
+    $$PWD/qsocketiometrics_p.h \
+    $$PWD/qsocketiotrace_p.h \
+    $$PWD/qsocketiojournal_p.h \
+    $$PWD/qsocketiodeflate_p.h \
+    $$PWD/qsocketioattachments_p.h
 
 SOURCES += \
-    $$PWD/qsocketioclient.cpp
+    $$PWD/qsocketioclient.cpp \
+    $$PWD/qsocketioclientpool.cpp \
+    $$PWD/qcallback.cpp \
+    $$PWD/qsocketionamespace.cpp \
+    $$PWD/qsocketioresponder.cpp \
+    $$PWD/qsocketioframeparser.cpp \
+    $$PWD/qsocketioframewriter.cpp \
+    $$PWD/qsocketioacktable.cpp \
+    $$PWD/qsocketiothreading.cpp \
+    $$PWD/qsocketiometrics.cpp \
+    $$PWD/qsocketiotrace.cpp \
+    $$PWD/qsocketiojournal.cpp \
+    $$PWD/qsocketiodeflate.cpp \
+    $$PWD/qsocketioattachments.cpp
 
 HEADERS += $$PUBLIC_HEADERS $$PRIVATE_HEADERS
 
@@ -0,0 +1,14 @@
+CONFIG += testcase c++11
+TARGET = tst_qsocketioclient
+QT = core network websockets testlib socketio
+
+#the loopback server of the benchmark example
+MOCKSERVER = $$PWD/../../../examples/benchmark
+INCLUDEPATH += $$MOCKSERVER
+
+SOURCES += \
+    tst_qsocketioclient.cpp \
+    $$MOCKSERVER/mockserver.cpp
+
+HEADERS += \
+    $$MOCKSERVER/mockserver.h
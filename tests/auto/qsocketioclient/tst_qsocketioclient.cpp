@@ -0,0 +1,237 @@
+#include <QtTest/QtTest>
+#include <QtSocketIo/QSocketIoClient>
+#include <QtSocketIo/QSocketIoClientPool>
+#include <QtCore/QThread>
+#include <QtCore/QJsonArray>
+#include "mockserver.h"
+#include <algorithm>
+#include <limits>
+
+class tst_QSocketIoClient : public QObject
+{
+    Q_OBJECT
+public:
+    tst_QSocketIoClient();
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void concurrentAcks_data();
+    void concurrentAcks();
+    void messageIdWraparound();
+    void heartbeats();
+    void deadConnection();
+    void errorAndNoop();
+
+private:
+    void configureServer(int heartbeatInterval, int closeTimeout);
+
+    QThread m_serverThread;
+    MockServer *m_pServer;
+    QUrl m_url;
+};
+
+tst_QSocketIoClient::tst_QSocketIoClient() :
+    m_serverThread(),
+    m_pServer(Q_NULLPTR),
+    m_url()
+{
+}
+
+void tst_QSocketIoClient::initTestCase()
+{
+    m_pServer = new MockServer;
+    m_pServer->moveToThread(&m_serverThread);
+    m_serverThread.start();
+    bool listening = false;
+    QMetaObject::invokeMethod(m_pServer, "listen", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, listening), Q_ARG(quint16, 0));
+    QVERIFY(listening);
+    m_url = QUrl(QStringLiteral("ws://127.0.0.1:%1").arg(m_pServer->port()));
+}
+
+void tst_QSocketIoClient::cleanupTestCase()
+{
+    m_pServer->deleteLater();
+    m_serverThread.quit();
+    m_serverThread.wait();
+}
+
+void tst_QSocketIoClient::concurrentAcks_data()
+{
+    QTest::addColumn<int>("clients");
+    QTest::addColumn<int>("threads");
+    QTest::addColumn<int>("messages");
+
+    QTest::newRow("one thread") << 16 << 1 << 200;
+    QTest::newRow("four threads") << 64 << 4 << 200;
+    QTest::newRow("more threads than cores") << 64 << 2 * QThread::idealThreadCount() << 100;
+}
+
+//every client has its own message ids, so the ids repeat across clients
+//and threads; each ack has to reach the callback of its own emit all the
+//same. The server acknowledges with the emitted arguments.
+void tst_QSocketIoClient::concurrentAcks()
+{
+    QFETCH(int, clients);
+    QFETCH(int, threads);
+    QFETCH(int, messages);
+
+    QAtomicInt acks(0);
+    QAtomicInt misrouted(0);
+    QAtomicInt errors(0);
+    QSocketIoClientPool pool;
+    QVERIFY(pool.open(m_url, clients, threads));
+    QTRY_COMPARE_WITH_TIMEOUT(m_pServer->connections(), clients, 30000);
+
+    for (int i = 0; i < messages; ++i) {
+        for (int c = 0; c < clients; ++c) {
+            QAtomicInt *pAcks = &acks;
+            QAtomicInt *pMisrouted = &misrouted;
+            QAtomicInt *pErrors = &errors;
+            const bool emitted = pool.client(c)->emitMessage(
+                        QStringLiteral("echo"), QVariant(QVariantList() << c << i),
+                        [pAcks, pMisrouted, c, i](QJsonArray arguments) {
+                if (arguments.at(0).toInt() != c || arguments.at(1).toInt() != i) {
+                    pMisrouted->fetchAndAddRelaxed(1);
+                }
+                pAcks->fetchAndAddRelaxed(1);
+            }, [pErrors](QSocketIo::AckError) {
+                pErrors->fetchAndAddRelaxed(1);
+            });
+            QVERIFY(emitted);
+        }
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(acks.loadAcquire() + errors.loadAcquire(), clients * messages,
+                              60000);
+    QCOMPARE(errors.loadAcquire(), 0);
+    QCOMPARE(misrouted.loadAcquire(), 0);
+
+    pool.close();
+    QTRY_COMPARE_WITH_TIMEOUT(m_pServer->connections(), 0, 30000);
+}
+
+//after INT_MAX the ids start over at 1; ids whose acks are still pending
+//are skipped, so that two acks never share a callback
+void tst_QSocketIoClient::messageIdWraparound()
+{
+#ifndef QT_BUILD_INTERNAL
+    QSKIP("needs the autotest seam of a developer build");
+#else
+    QSocketIoClient client;
+    QSignalSpy connectedSpy(&client, SIGNAL(connected(QString)));
+    QVERIFY(client.open(m_url));
+    QTRY_COMPARE(connectedSpy.count(), 1);
+
+    QList<int> acked;
+    int errors = 0;
+    const auto emitHeld = [&client, &acked, &errors](int value) {
+        return client.emitMessage(QStringLiteral("hold"), QVariant(QVariantList() << value),
+                                  [&acked, value](QJsonArray arguments) {
+            acked << (arguments.at(0).toInt() == value ? value : -1);
+        }, [&errors](QSocketIo::AckError) {
+            ++errors;
+        });
+    };
+
+    //the server holds these acks back, so that id 1 is pending at the wrap
+    client.setLastMessageId(0);
+    QVERIFY(emitHeld(1));
+    QCOMPARE(client.lastMessageId(), 1);
+    client.setLastMessageId(std::numeric_limits<int>::max() - 1);
+    QVERIFY(emitHeld(2));
+    QCOMPARE(client.lastMessageId(), std::numeric_limits<int>::max());
+    QVERIFY(emitHeld(3));
+    QCOMPARE(client.lastMessageId(), 2);
+    QCOMPARE(client.pendingAcks(), 3);
+
+    client.emitMessage(QStringLiteral("release"), 0);
+    QTRY_COMPARE(acked.size(), 3);
+    std::sort(acked.begin(), acked.end());
+    QCOMPARE(acked, QList<int>() << 1 << 2 << 3);
+    QCOMPARE(errors, 0);
+    QCOMPARE(client.pendingAcks(), 0);
+
+    client.close();
+    QTRY_COMPARE(m_pServer->connections(), 0);
+#endif
+}
+
+//the close timeout is advertised by the handshakes that follow
+void tst_QSocketIoClient::configureServer(int heartbeatInterval, int closeTimeout)
+{
+    QMetaObject::invokeMethod(m_pServer, "setHeartbeatInterval", Qt::BlockingQueuedConnection,
+                              Q_ARG(int, heartbeatInterval));
+    QMetaObject::invokeMethod(m_pServer, "setCloseTimeout", Qt::BlockingQueuedConnection,
+                              Q_ARG(int, closeTimeout));
+}
+
+//the client answers server heartbeats, and they keep it alive well past
+//the close timeout
+void tst_QSocketIoClient::heartbeats()
+{
+    configureServer(200, 1);
+    QSocketIoClient client;
+    client.setReconnectionEnabled(false);
+    QSignalSpy connectedSpy(&client, SIGNAL(connected(QString)));
+    QSignalSpy disconnectedSpy(&client, SIGNAL(disconnected(QString)));
+    QSignalSpy heartbeatSpy(&client, SIGNAL(heartbeatReceived()));
+    QVERIFY(client.open(m_url));
+    QTRY_COMPARE(connectedSpy.count(), 1);
+
+    QTest::qWait(2500);
+    QVERIFY(heartbeatSpy.count() >= 5);
+    QCOMPARE(disconnectedSpy.count(), 0);
+
+    client.close();
+    configureServer(25000, 60);
+    QTRY_COMPARE(m_pServer->connections(), 0);
+}
+
+//a server that goes silent is given up on after the close timeout
+void tst_QSocketIoClient::deadConnection()
+{
+    configureServer(0, 1);
+    QSocketIoClient client;
+    client.setReconnectionEnabled(false);
+    QSignalSpy connectedSpy(&client, SIGNAL(connected(QString)));
+    QSignalSpy disconnectedSpy(&client, SIGNAL(disconnected(QString)));
+    QVERIFY(client.open(m_url));
+    QTRY_COMPARE(connectedSpy.count(), 1);
+
+    QTRY_COMPARE_WITH_TIMEOUT(disconnectedSpy.count(), 1, 5000);
+    QCOMPARE(disconnectedSpy.at(0).at(0).toString(), QString());
+
+    configureServer(25000, 60);
+    QTRY_COMPARE(m_pServer->connections(), 0);
+}
+
+void tst_QSocketIoClient::errorAndNoop()
+{
+    QSocketIoClient client;
+    QSignalSpy connectedSpy(&client, SIGNAL(connected(QString)));
+    QSignalSpy errorSpy(&client, SIGNAL(errorReceived(QString,QString)));
+    QVERIFY(client.open(m_url));
+    QTRY_COMPARE(connectedSpy.count(), 1);
+
+    client.emitMessage(QStringLiteral("fault"),
+                       QVariantList() << QStringLiteral("unauthorized")
+                                      << QStringLiteral("reconnect"));
+    QTRY_COMPARE(errorSpy.count(), 1);
+    QCOMPARE(errorSpy.at(0).at(0).toString(), QStringLiteral("unauthorized"));
+    QCOMPARE(errorSpy.at(0).at(1).toString(), QStringLiteral("reconnect"));
+
+    //the noop that follows the error changes nothing
+    client.emitMessage(QStringLiteral("echo"), QVariant(1), [](QJsonArray) {},
+                       [](QSocketIo::AckError) {});
+    QTRY_COMPARE(client.pendingAcks(), 0);
+    QCOMPARE(errorSpy.count(), 1);
+
+    client.close();
+    QTRY_COMPARE(m_pServer->connections(), 0);
+}
+
+QTEST_MAIN(tst_QSocketIoClient)
+
+#include "tst_qsocketioclient.moc"
@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_qsocketioframeparser
+QT = core testlib socketio
+
+SOURCES += tst_qsocketioframeparser.cpp
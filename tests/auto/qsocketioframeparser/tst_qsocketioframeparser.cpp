@@ -0,0 +1,215 @@
+#include <QtTest/QtTest>
+#include <QtSocketIo/QSocketIoFrameParser>
+
+Q_DECLARE_METATYPE(QSocketIoFrameParser::PacketType)
+
+namespace
+{
+//\ufffd<length>\ufffd<packet>, with the length in UTF-16 code units as a
+//socket.io 0.9 server counts it
+QByteArray framed(const QByteArray &packet)
+{
+    const QByteArray separator = QString(QChar(0xfffd)).toUtf8();
+    return separator + QByteArray::number(QString::fromUtf8(packet).size()) + separator + packet;
+}
+}
+
+class tst_QSocketIoFrameParser : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void parse_data();
+    void parse();
+    void parseInvalid_data();
+    void parseInvalid();
+    void parseAck_data();
+    void parseAck();
+    void readFramedPacket_data();
+    void readFramedPacket();
+    void readFramedPacketByteLength();
+    void writeFramedPacket_data();
+    void writeFramedPacket();
+};
+
+void tst_QSocketIoFrameParser::parse_data()
+{
+    QTest::addColumn<QByteArray>("frame");
+    QTest::addColumn<QSocketIoFrameParser::PacketType>("packetType");
+    QTest::addColumn<int>("messageId");
+    QTest::addColumn<bool>("dataAck");
+    QTest::addColumn<QByteArray>("endpoint");
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("heartbeat") << QByteArray("2::") << QSocketIoFrameParser::HeartbeatPacket
+                               << 0 << false << QByteArray() << QByteArray();
+    QTest::newRow("connect") << QByteArray("1::/chat") << QSocketIoFrameParser::ConnectPacket
+                             << 0 << false << QByteArray("/chat") << QByteArray();
+    QTest::newRow("event") << QByteArray("5:::{\"name\":\"tick\",\"args\":[42]}")
+                           << QSocketIoFrameParser::EventPacket << 0 << false << QByteArray()
+                           << QByteArray("{\"name\":\"tick\",\"args\":[42]}");
+    QTest::newRow("event with data ack")
+            << QByteArray("5:17+:/chat:{\"name\":\"a:b\"}") << QSocketIoFrameParser::EventPacket
+            << 17 << true << QByteArray("/chat") << QByteArray("{\"name\":\"a:b\"}");
+    QTest::newRow("multibyte event")
+            << QByteArray("5:::{\"name\":\"gr\xc3\xbc\xc3\x9f\",\"args\":[\"\xe2\x82\xac"
+                          "\xf0\x9f\x98\x80\"]}")
+            << QSocketIoFrameParser::EventPacket << 0 << false << QByteArray()
+            << QByteArray("{\"name\":\"gr\xc3\xbc\xc3\x9f\",\"args\":[\"\xe2\x82\xac"
+                          "\xf0\x9f\x98\x80\"]}");
+    QTest::newRow("multibyte endpoint")
+            << QByteArray("5:3:/ch\xc3\xa4t:{\"name\":\"\xe2\x82\xac\"}")
+            << QSocketIoFrameParser::EventPacket << 3 << false << QByteArray("/ch\xc3\xa4t")
+            << QByteArray("{\"name\":\"\xe2\x82\xac\"}");
+    QTest::newRow("multibyte message")
+            << QByteArray("3:::\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e")
+            << QSocketIoFrameParser::MessagePacket << 0 << false << QByteArray()
+            << QByteArray("\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e");
+}
+
+//the data has to come back byte for byte, without a round trip through
+//Latin-1
+void tst_QSocketIoFrameParser::parse()
+{
+    QFETCH(QByteArray, frame);
+    QFETCH(QSocketIoFrameParser::PacketType, packetType);
+    QFETCH(int, messageId);
+    QFETCH(bool, dataAck);
+    QFETCH(QByteArray, endpoint);
+    QFETCH(QByteArray, data);
+
+    QSocketIoFrameParser parser;
+    QVERIFY(parser.parse(frame));
+    QCOMPARE(parser.packetType(), packetType);
+    QCOMPARE(parser.messageId(), messageId);
+    QCOMPARE(parser.isDataAck(), dataAck);
+    QCOMPARE(parser.endpoint(), endpoint);
+    QCOMPARE(parser.data(), data);
+    QCOMPARE(QString::fromUtf8(parser.data()), QString::fromUtf8(data));
+}
+
+void tst_QSocketIoFrameParser::parseInvalid_data()
+{
+    QTest::addColumn<QByteArray>("frame");
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("no colon") << QByteArray("5");
+    QTest::newRow("unknown type") << QByteArray("9::");
+    QTest::newRow("multibyte type") << QByteArray("\xc3\xa4::");
+    QTest::newRow("id overflow") << QByteArray("5:99999999999::");
+    QTest::newRow("multibyte id") << QByteArray("5:1\xc3\xa4::");
+}
+
+void tst_QSocketIoFrameParser::parseInvalid()
+{
+    QFETCH(QByteArray, frame);
+
+    QSocketIoFrameParser parser;
+    QVERIFY(!parser.parse(frame));
+    QCOMPARE(parser.packetType(), QSocketIoFrameParser::InvalidPacket);
+}
+
+void tst_QSocketIoFrameParser::parseAck_data()
+{
+    QTest::addColumn<QByteArray>("frame");
+    QTest::addColumn<int>("messageId");
+    QTest::addColumn<QByteArray>("arguments");
+
+    QTest::newRow("plain") << QByteArray("6:::12") << 12 << QByteArray();
+    QTest::newRow("data") << QByteArray("6:::13+[\"ok\",{\"count\":3}]") << 13
+                          << QByteArray("[\"ok\",{\"count\":3}]");
+    QTest::newRow("multibyte data")
+            << QByteArray("6::/chat:14+[\"\xc3\xbc\",\"\xe2\x82\xac\",\"\xf0\x9f\x98\x80\"]")
+            << 14 << QByteArray("[\"\xc3\xbc\",\"\xe2\x82\xac\",\"\xf0\x9f\x98\x80\"]");
+}
+
+void tst_QSocketIoFrameParser::parseAck()
+{
+    QFETCH(QByteArray, frame);
+    QFETCH(int, messageId);
+    QFETCH(QByteArray, arguments);
+
+    QSocketIoFrameParser parser;
+    QVERIFY(parser.parse(frame));
+    QCOMPARE(parser.packetType(), QSocketIoFrameParser::AckPacket);
+    int ackedId = 0;
+    QByteArray ackArguments;
+    QVERIFY(QSocketIoFrameParser::parseAck(parser.data(), &ackedId, &ackArguments));
+    QCOMPARE(ackedId, messageId);
+    QCOMPARE(ackArguments, arguments);
+}
+
+void tst_QSocketIoFrameParser::readFramedPacket_data()
+{
+    QTest::addColumn<QList<QByteArray> >("packets");
+
+    QTest::newRow("ascii") << (QList<QByteArray>() << "2::" << "5:::{\"name\":\"tick\"}");
+    QTest::newRow("two byte sequences")
+            << (QList<QByteArray>() << "3:::gr\xc3\xbc\xc3\x9f" << "3:::\xc3\xa4\xc3\xb6");
+    QTest::newRow("three byte sequences")
+            << (QList<QByteArray>() << "5:::{\"name\":\"\xe2\x82\xac\"}" << "2::");
+    QTest::newRow("surrogate pairs")
+            << (QList<QByteArray>() << "3:::\xf0\x9f\x98\x80\xf0\x9f\x98\x81" << "3:::x");
+    QTest::newRow("mixed")
+            << (QList<QByteArray>() << "6:::7+[\"\xc3\xbc\xe2\x82\xac\xf0\x9f\x98\x80\"]"
+                                    << "5:::{\"args\":[\"\xe6\x97\xa5\"]}" << "2::");
+}
+
+void tst_QSocketIoFrameParser::readFramedPacket()
+{
+    QFETCH(QList<QByteArray>, packets);
+
+    QByteArray payload;
+    for (int i = 0; i < packets.size(); ++i) {
+        payload += framed(packets.at(i));
+    }
+    QVERIFY(QSocketIoFrameParser::isFramedPayload(payload));
+
+    int position = 0;
+    QByteArray packet;
+    for (int i = 0; i < packets.size(); ++i) {
+        QVERIFY(QSocketIoFrameParser::readFramedPacket(payload, &position, &packet));
+        QCOMPARE(packet, packets.at(i));
+    }
+    QCOMPARE(position, payload.size());
+    QVERIFY(!QSocketIoFrameParser::readFramedPacket(payload, &position, &packet));
+}
+
+//a length that counts bytes instead of UTF-16 code units runs past the
+//packet, and must not split the payload somewhere in the middle
+void tst_QSocketIoFrameParser::readFramedPacketByteLength()
+{
+    const QByteArray separator = QString(QChar(0xfffd)).toUtf8();
+    const QByteArray packet("3:::\xe2\x82\xac");
+    const QByteArray payload = separator + QByteArray::number(packet.size()) + separator + packet;
+
+    int position = 0;
+    QByteArray read;
+    QVERIFY(!QSocketIoFrameParser::readFramedPacket(payload, &position, &read));
+    QCOMPARE(position, 0);
+}
+
+void tst_QSocketIoFrameParser::writeFramedPacket_data()
+{
+    readFramedPacket_data();
+}
+
+//what the client sends has to frame the same way as what it reads
+void tst_QSocketIoFrameParser::writeFramedPacket()
+{
+    QFETCH(QList<QByteArray>, packets);
+
+    QByteArray expected;
+    QByteArray payload;
+    for (int i = 0; i < packets.size(); ++i) {
+        const QByteArray &packet = packets.at(i);
+        expected += framed(packet);
+        QSocketIoFrameParser::writeFramedPacket(&payload, packet.constData(), packet.size());
+        QCOMPARE(QSocketIoFrameParser::utf16Length(packet.constData(), packet.size()),
+                 QString::fromUtf8(packet).size());
+    }
+    QCOMPARE(payload, expected);
+}
+
+QTEST_APPLESS_MAIN(tst_QSocketIoFrameParser)
+
+#include "tst_qsocketioframeparser.moc"